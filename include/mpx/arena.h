@@ -0,0 +1,84 @@
+#ifndef MPX_ARENA_H
+#define MPX_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ @file mpx/arena.h
+ @brief Bump allocated memory arenas, released all at once
+*/
+
+struct arena_chunk;
+
+/**
+ @struct arena
+ @brief
+    Memory handed out by advancing a pointer through chunks taken from the
+    heap. Individual allocations are never freed, the arena returns all of its
+    chunks to the heap at once. A zeroed arena is empty and disabled.
+ @var arena::chunks
+    Chunks taken from the heap, the current one first.
+ @var arena::bump
+    Next free byte of the current chunk.
+ @var arena::end
+    End of the current chunk.
+ @var arena::enabled
+    Non-zero if allocations should be served from the arena.
+*/
+struct arena {
+    struct arena_chunk* chunks;
+    uintptr_t bump;
+    uintptr_t end;
+    unsigned char enabled;
+};
+
+/** Size of the chunks an arena takes from the heap, larger requests get a chunk of their own. */
+#define MPX_ARENA_CHUNK_SZ (4096)
+
+/**
+ @brief
+    Allocates memory from an arena, taking a new chunk from the heap if the
+    current one cannot fit the request.
+ @param arena
+    The arena to allocate from.
+ @param size
+    The number of bytes to allocate.
+ @return
+    The allocated memory, NULL if no chunk could be taken from the heap.
+*/
+void* arena_alloc(struct arena* arena, size_t size);
+
+/**
+ @brief
+    Checks whether memory was allocated from an arena.
+ @param arena
+    The arena to check.
+ @param ptr
+    The memory to look for.
+ @return
+    Non-zero if ptr lies within one of the arena's chunks, which are walked in turn.
+*/
+int arena_owns(const struct arena* arena, const void* ptr);
+
+/**
+ @brief
+    Frees a single allocation of an arena. The memory is not reused until the
+    arena is released, this only checks the pointer and marks it freed.
+ @param ptr
+    The memory to free, which arena_owns() found to be owned by an arena.
+ @return
+    0 on success, -1 if ptr is not the start of an allocation or was already freed.
+*/
+int arena_free(void* ptr);
+
+/**
+ @brief
+    Returns every chunk of an arena to the heap, freeing all of its allocations
+    in one operation. The arena stays usable and keeps whether it is enabled.
+ @param arena
+    The arena to release.
+*/
+void arena_release(struct arena* arena);
+
+#endif // MPX_ARENA_H
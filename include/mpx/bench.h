@@ -0,0 +1,38 @@
+#ifndef MPX_BENCH_H
+#define MPX_BENCH_H
+
+#include <mpx/device.h>
+
+/**
+ @file mpx/bench.h
+ @brief TSC based microbenchmarks of the kernel's system call, scheduling and PCB paths
+*/
+
+/** Number of samples taken per benchmark. */
+#define MPX_BENCH_SAMPLES (1000)
+
+/** Deepest queue the PCB insert/remove benchmark measures at. */
+#define MPX_BENCH_QUEUE_DEPTH_MAX (1000)
+
+/**
+ @brief
+    Runs every benchmark from within a process and writes one line per result
+    in the form
+    `bench name=<name> [depth=<n>] n=<samples> min=<c> median=<c> p99=<c> max=<c>`,
+    where all figures are TSC cycles. The IDLE ping-pong benchmark blocks the
+    calling process while two helper processes run.
+ @param dev
+    The device results are written to.
+ @return
+    0 on success, a negative value if a benchmark could not be set up.
+*/
+int bench_run(device dev);
+
+/**
+ @brief
+    Entry point for a process that runs bench_run() on COM1 and exits. Started
+    by kmain in place of the command handler when built with MPX_BENCH_AT_BOOT=1.
+*/
+void bench_process(void);
+
+#endif // MPX_BENCH_H
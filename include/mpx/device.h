@@ -2,6 +2,7 @@
 #define MPX_DEVICES_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <mpx/pcb.h>
 
 typedef enum {
@@ -25,18 +26,32 @@ struct iocb
     unsigned char io_op: 1;
 };
 
+// a queue of I/O operations of one direction, only the head is in progress
+struct iocb_queue
+{
+    struct iocb* head; // if NULL, the queue is idle and its other state should be ignored
+    struct iocb* tail;
+    size_t buffer_idx; // indicates progress (how much has been read from, written to the head's buffer)
+    unsigned char event: 1; // set once the head operation has completed
+};
+
 struct dcb
 {
     device dev;
-    struct iocb* iocb_queue_head; // if pcb_rq is NULL, the dcb is idle and other state in iocb should be ignored
-    struct iocb* iocb_queue_tail;
+    struct iocb_queue rx_queue; // READ operations, fed by input interrupts
+    struct iocb_queue tx_queue; // WRITE operations, drained by output interrupts
     unsigned char* rbuffer;
     size_t rbuffer_sz;
     size_t rbuffer_idx_begin; // read index (to read from next)
     size_t rbuffer_idx_end; // write index (to write to next) [if begin == end, rbuffer must be empty]
-    size_t buffer_idx; // indicates progress (how much has been read from, written to the iocb buffer)
     unsigned char open:  1; // initialization state
-    unsigned char event: 1; // event flag
+    size_t tx_fifo_sz; // bytes the transmit FIFO holds, detected when opened (1 without a working FIFO)
+    uint32_t tx_irqs; // transmit interrupts that moved output along
+    uint32_t tx_bytes; // bytes handed to the transmitter
+    size_t rx_trigger; // bytes the receive FIFO interrupts at, which depends on its size
+    uint32_t rx_irqs; // receive interrupts, data available or character timeout
+    uint32_t rx_bytes; // bytes taken from the receiver
+    uint32_t rx_overruns; // overrun errors reported, each losing at least one byte
 };
 
 #endif
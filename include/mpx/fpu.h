@@ -0,0 +1,39 @@
+#ifndef MPX_FPU_H
+#define MPX_FPU_H
+
+/**
+ @file mpx/fpu.h
+ @brief Lazy x87/SSE state switching between processes
+*/
+
+struct pcb;
+
+/**
+ @brief
+    Enables the x87 FPU and, where supported, SSE with FXSAVE/FXRSTOR, and
+    installs the device-not-available (#NM) handler that switches FPU state
+    on first use after a context switch.
+ @return
+    0 on success. A negative value if the CPU lacks FXSR, in which case the
+    FPU is left disabled and any use of it panics as before.
+*/
+int fpu_init(void);
+
+/**
+ @brief
+    Called on every context switch once pcb_running is the next process. Sets
+    CR0.TS so the next FPU instruction traps, unless the next process already
+    owns the FPU registers.
+*/
+void fpu_switch(void);
+
+/**
+ @brief
+    Discards any FPU state held in the registers on behalf of a process, e.g,
+    when it is freed.
+ @param pcb
+    The process to release the FPU from.
+*/
+void fpu_release(struct pcb* pcb);
+
+#endif // MPX_FPU_H
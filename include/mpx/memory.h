@@ -8,27 +8,91 @@
  @brief MPX-specific dynamic memory functions.
 */
 
+#include <stdint.h>
+#include <mpx/device.h>
+
+/**
+ @struct mcb
+ @brief
+    Memory control block heading every block of the heap. It is followed by the
+    block's usable space and then by a struct mcb_tag.
+ @var mcb::blk_check
+    MCB_MAGIC mixed with the address and size of the block. Only the header of a
+    live block carries a matching value, so pointers into the middle of blocks and
+    headers absorbed by merging are recognized.
+ @var mcb::blk_size
+    Usable size of the block in bytes, excluding the mcb and tag.
+ @var mcb::blk_free
+    Non-zero if the block is free.
+ @var mcb::prof_slot
+    Allocation profile entry the block is charged to, only present when built
+    with MPX_HEAP_PROFILE. Only valid while the block is allocated.
+ @var mcb::p_prev
+    Previous block in the same free list. Only valid while the block is free.
+ @var mcb::p_next
+    Next block in the same free list. Only valid while the block is free.
+*/
 struct mcb
 {
+    uint32_t blk_check;
+    size_t blk_size;
+    unsigned char blk_free;
+#if MPX_HEAP_PROFILE
+    unsigned char prof_slot;
+#endif
     struct mcb* p_prev;
     struct mcb* p_next;
-    size_t blk_size;
 };
 
-extern struct mcb* free_head;
-extern struct mcb* alloc_head;
+/**
+ @struct mcb_tag
+ @brief
+    Boundary tag closing every block of the heap, so the block physically
+    preceding another can be found from the other's mcb.
+ @var mcb_tag::blk_size_inuse
+    The block's size, with MCB_TAG_INUSE set while the block is allocated.
+*/
+struct mcb_tag
+{
+    size_t blk_size_inuse;
+};
+
+#define MCB_MAGIC     (0x4D434221u)
+#define MCB_TAG_INUSE ((size_t)1)
 
 /**
  @brief
-    Initializes the heap space available to MPX and processes.
+    Initializes the heap space available to MPX and processes. The heap is mapped
+    at VM_HEAP_BASE, its initial pages backed as they are touched, and grows as
+    needed up to VM_HEAP_MAX bytes, returning pages at its end to the frame
+    allocator once they are free again.
  @param size
-    Size of the global heap to allocate.
+    Initial size of the global heap, which it never shrinks below.
 */
 void initialize_heap(size_t size);
 
 /**
  @brief
-    Requests a memory allocation from the global heap.
+    Gets the first block of the heap, for walking every block in address order.
+ @return
+    The first block, NULL if the heap is not initialized.
+*/
+struct mcb* heap_block_first(void);
+
+/**
+ @brief
+    Gets the block physically following another in the heap.
+ @param mcb
+    A block obtained from heap_block_first() or heap_block_next().
+ @return
+    The following block, NULL if mcb is the last block of the heap.
+*/
+struct mcb* heap_block_next(const struct mcb* mcb);
+
+/**
+ @brief
+    Requests a memory allocation from the global heap. Free blocks are kept in
+    two-level segregated fit lists, so allocation takes constant time.
  @param size
     The size, in bytes, of the requested allocation.
  @return
@@ -39,7 +103,8 @@ void* allocate_memory(size_t size);
 
 /**
  @brief
-    Requests a memory allocation from the global heap.
+    Frees an allocation made from the global heap in constant time, merging it
+    with free physical neighbours.
  @param ptr
     A valid pointer to the start address of an allocated memory block.
  @return
@@ -48,4 +113,134 @@ void* allocate_memory(size_t size);
 */
 int free_memory(void* ptr);
 
+/** Number of buckets in the histogram of allocation sizes. */
+#define MPX_HEAP_HIST_BUCKETS (12)
+
+/** Upper bound of the first histogram bucket, each following bucket doubles it. */
+#define MPX_HEAP_HIST_MIN (16)
+
+/**
+ @struct heap_stats
+ @brief
+    Utilization and fragmentation of the global heap. Sizes count the usable
+    bytes of blocks, without their headers and tags.
+ @var heap_stats::bytes_heap
+    Size of the heap, including headers and tags.
+ @var heap_stats::bytes_in_use
+    Bytes in allocated blocks.
+ @var heap_stats::bytes_free
+    Bytes in free blocks.
+ @var heap_stats::largest_free
+    Size of the largest free block.
+ @var heap_stats::used_blocks
+    Number of allocated blocks.
+ @var heap_stats::free_blocks
+    Number of free blocks.
+ @var heap_stats::frag_permille
+    External fragmentation, the share of free bytes outside the largest free
+    block, in thousandths.
+ @var heap_stats::allocs
+    Number of successful allocations.
+ @var heap_stats::frees
+    Number of successful frees.
+ @var heap_stats::fails
+    Number of allocations that could not be served.
+ @var heap_stats::size_hist
+    Number of allocations requested by size. Bucket 0 counts sizes up to
+    MPX_HEAP_HIST_MIN bytes, each following bucket sizes up to twice the bound
+    of the one before, and the last bucket every larger size.
+*/
+struct heap_stats {
+    size_t bytes_heap;
+    size_t bytes_in_use;
+    size_t bytes_free;
+    size_t largest_free;
+    uint32_t used_blocks;
+    uint32_t free_blocks;
+    uint32_t frag_permille;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t fails;
+    uint32_t size_hist[MPX_HEAP_HIST_BUCKETS];
+};
+
+/**
+ @brief
+    Gets the statistics of the global heap. They are kept up to date by every
+    allocation and free, so reading them does not walk the heap.
+ @param stats
+    Filled with the current statistics.
+*/
+void heap_stats_get(struct heap_stats* stats);
+
+/** Number of call site and process pairs the allocation profile tracks, the last collects any others. */
+#define MPX_HEAP_PROFILE_SITES (64)
+
+/**
+ @struct heap_profile_site
+ @brief
+    Memory allocated from one call site on behalf of one process, as tracked
+    when built with MPX_HEAP_PROFILE.
+ @var heap_profile_site::site
+    Return address of the call to sys_alloc_mem() or allocate_memory(), NULL
+    for the entry collecting sites that did not fit in the profile.
+ @var heap_profile_site::pid
+    ID of the process running when the memory was allocated, 0 if none was.
+ @var heap_profile_site::live_bytes
+    Bytes allocated from the site and not yet freed.
+ @var heap_profile_site::live_count
+    Number of blocks allocated from the site and not yet freed.
+ @var heap_profile_site::allocs
+    Number of allocations made from the site.
+*/
+struct heap_profile_site {
+    void* site;
+    unsigned int pid;
+    size_t live_bytes;
+    uint32_t live_count;
+    uint32_t allocs;
+};
+
+/**
+ @brief
+    Records the call site the next allocation of the running process is made
+    for, so allocations made through wrappers such as sys_alloc_mem() are
+    charged to the wrapper's caller. Does nothing unless built with
+    MPX_HEAP_PROFILE.
+ @param site
+    The return address to charge, NULL to charge the caller of allocate_memory().
+*/
+void heap_profile_set_site(void* site);
+
+/**
+ @brief
+    Gets the allocation profile, sorted by live bytes, largest first.
+ @param sites
+    Filled with up to max entries.
+ @param max
+    The number of entries sites can hold.
+ @return
+    The number of entries filled, -1 if the kernel was built without
+    MPX_HEAP_PROFILE.
+*/
+int heap_profile_get(struct heap_profile_site* sites, int max);
+
+/** Number of heap operations kept by the trace when built with MPX_HEAP_TRACE. Must be a power of two. */
+#define MPX_HEAP_TRACE_LEN (1024)
+
+/**
+ @brief
+    Writes the heap trace to a device, oldest operation first. When the kernel
+    is built with MPX_HEAP_TRACE set, allocate_memory() and free_memory() record
+    the last MPX_HEAP_TRACE_LEN operations with their size, pointer and time
+    stamp counter. The output is one "A size ptr tsc" or "F size ptr tsc" line
+    per operation between a begin and an end line, as read by the host side
+    heap replay tool. Operations made while dumping are not recorded.
+ @param dev
+    The device to write the trace to.
+ @return
+    0 on success, -1 if the kernel was built without the trace.
+*/
+int heap_trace_dump(device dev);
+
 #endif // MPX_MEMORY_H
@@ -0,0 +1,50 @@
+#ifndef MPX_MULTIBOOT_H
+#define MPX_MULTIBOOT_H
+
+#include <stdint.h>
+
+/**
+ @file mpx/multiboot.h
+ @brief Structures handed to the kernel by a multiboot (version 1) bootloader
+*/
+
+/** Value in eax at kernel entry when loaded by a multiboot bootloader. */
+#define MULTIBOOT_BOOTLOADER_MAGIC	0x2BADB002
+
+/** multiboot_info::mem_lower and mem_upper are valid. */
+#define MULTIBOOT_INFO_MEMORY	(1 << 0)
+/** multiboot_info::mmap_length and mmap_addr are valid. */
+#define MULTIBOOT_INFO_MEM_MAP	(1 << 6)
+
+/** Memory map entry type for RAM available to the OS. */
+#define MULTIBOOT_MEMORY_AVAILABLE	1
+
+/**
+ Boot information structure, pointed to by ebx at kernel entry.
+ Only the fields up to the memory map are declared.
+*/
+struct multiboot_info {
+	uint32_t flags;		/** which of the following fields are valid */
+	uint32_t mem_lower;	/** KiB of memory below 1 MiB */
+	uint32_t mem_upper;	/** KiB of memory from 1 MiB to the first hole */
+	uint32_t boot_device;
+	uint32_t cmdline;
+	uint32_t mods_count;
+	uint32_t mods_addr;
+	uint32_t syms[4];
+	uint32_t mmap_length;	/** size of the memory map in bytes */
+	uint32_t mmap_addr;	/** physical address of the memory map */
+} __attribute__((packed));
+
+/**
+ Memory map entry. `size` does not count itself, so the next entry
+ starts size + 4 bytes after this one.
+*/
+struct multiboot_mmap_entry {
+	uint32_t size;
+	uint64_t addr;
+	uint64_t len;
+	uint32_t type;
+} __attribute__((packed));
+
+#endif
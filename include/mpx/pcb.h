@@ -2,8 +2,10 @@
 #define MPX_PCB_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <mpx/device.h>
 #include <mpx/context.h>
+#include <mpx/arena.h>
 
 /**
  @file mpx/pcb.h
@@ -45,7 +47,45 @@ enum ProcClassState {
 
 #define MPX_PCB_STACK_SZ (4096)
 
-struct pcb_queue_node;
+/** Size of an FXSAVE image. */
+#define MPX_PCB_FPU_AREA_SZ (512)
+
+struct pcb_queue;
+
+/** Number of system call counters kept per process, one for each op_code in mpx/sys_req.h. */
+#define MPX_PCB_ACCT_OPS (6)
+
+/**
+ @struct pcb_acct
+ @brief
+    Scheduling and resource accounting for a process. Times are in TSC cycles.
+ @var pcb_acct::dispatches
+    Number of times the process has been dispatched.
+ @var pcb_acct::run_cycles
+    Time spent running.
+ @var pcb_acct::ready_cycles
+    Time spent ready, waiting to be dispatched.
+ @var pcb_acct::blocked_cycles
+    Time spent blocked, waiting on I/O or sleeping.
+ @var pcb_acct::state_since
+    TSC value when the time spent in the current execution state was last charged.
+ @var pcb_acct::syscalls
+    Number of system calls issued, indexed by op_code.
+ @var pcb_acct::bytes_read
+    Bytes transferred to the process by completed READ requests.
+ @var pcb_acct::bytes_written
+    Bytes transferred from the process by completed WRITE requests.
+*/
+struct pcb_acct {
+    uint32_t dispatches;
+    uint64_t run_cycles;
+    uint64_t ready_cycles;
+    uint64_t blocked_cycles;
+    uint64_t state_since;
+    uint32_t syscalls[MPX_PCB_ACCT_OPS];
+    uint32_t bytes_read;
+    uint32_t bytes_written;
+};
 
 /**
  @struct pcb_state
@@ -74,7 +114,13 @@ struct pcb_state {
     Defines a process control block (PCB) structure for maintaining process information
     for a process.
  @var pcb::p_next
-    Pointer to another node if the PCB is in a queue.
+    Pointer to the next node if the PCB is in a queue, NULL at the tail.
+ @var pcb::p_prev
+    Pointer to the previous node if the PCB is in a queue, NULL at the head.
+ @var pcb::p_queue
+    The queue the PCB is currently in, NULL if it is not queued.
+ @var pcb::p_level
+    The level of `p_queue` the PCB is linked into. Only valid while `p_queue` is not NULL.
  @var pcb::state
     The state of a PCB. Includes process execution, dispatch, class, and priority.
  @var pcb::pstackseg
@@ -85,31 +131,97 @@ struct pcb_state {
     which will be situated on top of the stack.
  @var pcb::pname
     The current name of a process.
+ @var pcb::pid
+    A numeric process identifier, unique among all live processes. Never 0.
+ @var pcb::p_name_next
+    Pointer to the next PCB in the same bucket of the process table's name index.
+ @var pcb::p_pid_next
+    Pointer to the next PCB in the same bucket of the process table's PID index.
+ @var pcb::p_timer_next
+    Pointer to the next PCB in the same timer wheel slot while sleeping.
+ @var pcb::p_timer_prev
+    Pointer to the previous PCB in the same timer wheel slot while sleeping.
+ @var pcb::p_timer_slot
+    The timer wheel slot the PCB is parked in, NULL if it is not sleeping.
+ @var pcb::timer_deadline
+    The tick the PCB sleeps until. Only valid while `p_timer_slot` is not NULL.
+ @var pcb::fpu_used
+    Set once the process has executed an FPU/SSE instruction, after which its
+    FPU state is saved and restored across context switches.
+ @var pcb::fpu_area
+    Storage for the FXSAVE image of the process' FPU state, aligned to 16 bytes at use.
+ @var pcb::acct
+    Scheduling and resource accounting for the process.
+ @var pcb::arena
+    Serves the process's sys_alloc_mem() calls once its enabled flag is set,
+    and is released when the PCB is freed. Disabled by pcb_setup(). Only suits
+    short-lived processes, as memory freed to the arena is not reused.
+ @var pcb::alloc_site
+    Call site the process's next allocation is charged to, only present when
+    built with MPX_HEAP_PROFILE. See heap_profile_set_site().
 */
 struct pcb {
     struct pcb* p_next;
+    struct pcb* p_prev;
+    struct pcb_queue* p_queue;
+    unsigned char p_level;
     struct pcb_state state;
     void* pstackseg;
     struct context* pctxt;
     char name[MPX_PCB_PROCNAME_BUFFER_SZ];
+    unsigned int pid;
+    struct pcb* p_name_next;
+    struct pcb* p_pid_next;
+    struct pcb* p_timer_next;
+    struct pcb* p_timer_prev;
+    struct pcb** p_timer_slot;
+    uint32_t timer_deadline;
+    unsigned char fpu_used;
+    unsigned char fpu_area[MPX_PCB_FPU_AREA_SZ + 15];
+    struct pcb_acct acct;
+    struct arena arena;
+#if MPX_HEAP_PROFILE
+    void* alloc_site;
+#endif
 };
 
+/** Number of buckets in each index of the process table. Must be a power of two. */
+#define MPX_PCB_TABLE_BUCKETS (64)
+
+#define MPX_PCB_PROCPRI_LEVELS (MPX_PCB_PROCPRI_MAX + 1)
+
 /**
- @struct pcb_queue
+ @struct pcb_queue_level
  @brief
-    A queue to hold queued PCB handles, linked list implementation.
- @var pcb_queue::pcb_head
-    If the queue is not empty, points to head/front of the queue which can be dequeued. NULL otherwise.
- @var pcb_queue::pcb_tail
-    If the queue is not empty, points to the tail/back of the queue to help enqueue an element.
+    A FIFO of PCBs sharing a single priority level, linked list implementation.
+ @var pcb_queue_level::pcb_head
+    If the level is not empty, points to head/front of the level which can be dequeued. NULL otherwise.
+ @var pcb_queue_level::pcb_tail
+    If the level is not empty, points to the tail/back of the level to help enqueue an element.
     NULL otherwise.
- @var pcb_queue::priority
-    Identifies whether the queue is a priority queue. If so, inserting via `pcb_insert()`
-    might not insert nodes at the tail and will insert based on first priority.
 */
-struct pcb_queue {
+struct pcb_queue_level {
     struct pcb* pcb_head;
     struct pcb* pcb_tail;
+};
+
+/**
+ @struct pcb_queue
+ @brief
+    A queue to hold queued PCB handles, made up of one FIFO per priority level.
+ @var pcb_queue::levels
+    FIFOs for each priority level, indexed by priority. A queue which is not a priority
+    queue only uses the first level.
+ @var pcb_queue::level_bitmap
+    Bit i is set if and only if levels[i] is not empty. The lowest set bit thus identifies
+    the highest priority level holding a PCB.
+ @var pcb_queue::ispriority
+    Identifies whether the queue is a priority queue. If so, inserting via `pcb_insert()`
+    will place the PCB at the tail of the level matching its priority.
+*/
+struct pcb_queue {
+    struct pcb_queue_level levels[MPX_PCB_PROCPRI_LEVELS];
+    unsigned short level_bitmap;
     const unsigned char ispriority;
 };
 
@@ -132,6 +244,30 @@ extern struct pcb_queue pcb_queues[QUEUE_SZ];
 */
 extern struct pcb* pcb_running;
 
+/** Number of PCB and stack pairs reserved at boot. */
+#define MPX_PCB_POOL_SZ (8)
+
+/**
+ @brief
+    Reserves PCB and stack pairs in the PCB cache. PCBs are allocated from the
+    cache and recycled into it when freed, keeping their stacks, and at least
+    this many are held even while unused.
+ @param capacity
+    Number of PCB and stack pairs to reserve.
+ @return
+    0 on success, a negative value if the pairs could not be allocated.
+*/
+int pcb_pool_init(size_t capacity);
+
+/**
+ @brief
+    Zeroes the stack of one recycled PCB so a later allocation need not.
+    Intended to be called while the system is idle.
+ @return
+    1 if a stack was zeroed, 0 if no recycled stack needed zeroing.
+*/
+int pcb_pool_scrub(void);
+
 /**
  @brief
     Allocate memory for a new PCB.
@@ -143,7 +279,8 @@ struct pcb* pcb_allocate(void);
 
 /**
  @brief
-    Frees all memory associated with a given PCB, including its stack.
+    Frees all memory associated with a given PCB, including its stack. The running
+    PCB is still on its stack, so its slot is only parked until pcb_reap().
  @param pcb
     A pointer to the pcb to free.
  @return
@@ -151,6 +288,13 @@ struct pcb* pcb_allocate(void);
 */
 int pcb_free(struct pcb* pcb);
 
+/**
+ @brief
+    Returns the slot of a process that freed itself while running to the PCB cache,
+    once another context is running. Called on every system call.
+*/
+void pcb_reap(void);
+
 /**
  @brief
     Allocates a new PCB, initializes it with data provided, and sets state to active-ready.
@@ -187,15 +331,73 @@ void pcb_context_init(struct pcb* pcb, void* func, void* fargs, size_t fargc);
 
 /**
  @brief
-    Searches all process queues for processes with the provided name.
+    Looks up a process by name in the process table. Every PCB returned by
+    pcb_setup() is indexed until it is passed to pcb_free().
  @param name
     Name of the process to find.
  @return
-    A non-NULL pointer to the found PCB on success. NULL if the provided name was\
-    not found in any queue.
+    A non-NULL pointer to the found PCB on success. NULL if no process has the
+    provided name.
 */
 struct pcb* pcb_find(const char* name);
 
+/**
+ @brief
+    Looks up a process by PID in the process table.
+ @param pid
+    PID of the process to find.
+ @return
+    A non-NULL pointer to the found PCB on success. NULL if no process has the
+    provided PID.
+*/
+struct pcb* pcb_find_pid(unsigned int pid);
+
+/**
+ @brief
+    Charges the time since the last charge to the counter for a PCB's current
+    execution state.
+ @param pcb
+    A pointer to the PCB to account for.
+*/
+void pcb_acct_update(struct pcb* pcb);
+
+/**
+ @brief
+    Changes the execution state of a PCB, charging the time spent in the previous
+    state and counting a dispatch when the new state is running.
+ @param pcb
+    A pointer to the PCB to change the state of.
+ @param exec
+    The new execution state.
+*/
+void pcb_set_exec(struct pcb* pcb, enum ProcExecState exec);
+
+/**
+ @brief
+    Allocates memory for the running process. Processes that enabled their
+    arena are served from it, others from the MPX heap. Installed as the
+    sys_alloc_mem() function. Built with MPX_HEAP_PROFILE, everything comes
+    from the heap so that every allocation is profiled.
+ @param size
+    The number of bytes to allocate.
+ @return
+    The allocated memory, NULL if it could not be allocated.
+*/
+void* pcb_alloc_mem(size_t size);
+
+/**
+ @brief
+    Frees memory for the running process. Memory from the running process's
+    arena is only released with the arena, anything else is returned to the
+    MPX heap. Installed as the sys_free_mem() function. With the arena enabled,
+    finding its memory walks its chunks, so the cost grows with the arena.
+ @param ptr
+    The memory to free.
+ @return
+    0 on success, -1 if ptr is not the start of an allocation or was already freed.
+*/
+int pcb_free_mem(void* ptr);
+
 /**
  @brief
     Inserts a PCB into the appropriate queue based on state and priority.
@@ -204,13 +406,45 @@ struct pcb* pcb_find(const char* name);
 */
 void pcb_insert(struct pcb* pcb);
 
+/**
+ @brief
+    Gets the front of a queue, i.e, the head of its highest priority non-empty level.
+ @param queue
+    A pointer to the queue to inspect.
+ @return
+    A pointer to the PCB at the front of the queue, NULL if the queue is empty.
+*/
+struct pcb* pcb_queue_front(const struct pcb_queue* queue);
+
+/**
+ @brief
+    Gets the PCB following another in a queue, continuing into lower priority levels
+    once the end of a level is reached. Used to walk a queue in dispatch order.
+ @param queue
+    A pointer to the queue the PCB resides in.
+ @param pcb
+    A pointer to a PCB in the queue.
+ @return
+    A pointer to the next PCB in the queue, NULL if pcb was the last.
+*/
+struct pcb* pcb_queue_next(const struct pcb_queue* queue, const struct pcb* pcb);
+
+/**
+ @brief
+    Dequeues the highest priority process from the active ready queue in constant time.
+ @return
+    A pointer to the dequeued PCB, NULL if no process is active and ready.
+*/
+struct pcb* pcb_next_ready(void);
+
 /**
  @brief
     Removes a PCB from its current queue without freeing memory or data structures.
+    Runs in constant time, as the PCB records the queue and level it is linked into.
  @param pcb
     A pointer to the PCB to dequeue.
  @return
-    0 on success, a negative value if there was an error.
+    0 on success, a negative value if the PCB is not in a queue.
 */
 int pcb_remove(struct pcb* pcb);
 
@@ -36,6 +36,14 @@ int serial_poll(device dev, char *buffer, size_t len);
 
 extern struct dcb serial_dcb_list[4];
 
+#ifndef MPX_SERIAL_RX_TRIGGER
+/**
+ Receive FIFO trigger level in bytes (1, 4, 8 or 14) of a 16 byte FIFO, normally set by the
+ Makefile's SERIAL_RX_TRIGGER. A 64 byte FIFO triggers at 1, 16, 32 or 56 bytes instead, see dcb::rx_trigger.
+*/
+#define MPX_SERIAL_RX_TRIGGER (14)
+#endif
+
 typedef enum serial_errors
 {
     SERIAL_ERR_DEV_NOT_FOUND       =   -1,
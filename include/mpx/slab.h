@@ -0,0 +1,120 @@
+#ifndef MPX_SLAB_H
+#define MPX_SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ @file mpx/slab.h
+ @brief Object caches for fixed size kernel objects, carved from heap backed slabs
+*/
+
+struct slab;
+
+/**
+ @struct slab_cache
+ @brief
+    A cache of equally sized objects. Objects are handed out from slabs, single
+    heap blocks holding several objects each, so they share one heap header per
+    slab instead of one per object. Free objects keep their constructed state,
+    so the constructor and destructor only run as slabs are created and released.
+ @var slab_cache::name
+    Name of the cache, for statistics.
+ @var slab_cache::obj_size
+    Size of an object in bytes.
+ @var slab_cache::ctor
+    Called on each object of a new slab, may be NULL. A non-zero return fails
+    creation of the slab.
+ @var slab_cache::dtor
+    Called on each object of a slab before it is released, may be NULL.
+ @var slab_cache::slabs_partial
+    Slabs with at least one free object.
+ @var slab_cache::slabs_full
+    Slabs with no free objects.
+ @var slab_cache::objs_min
+    Number of objects kept even when free, see slab_reserve().
+ @var slab_cache::p_next
+    Next cache in the list of all caches.
+ @var slab_cache::stat_allocs
+    Number of objects handed out.
+ @var slab_cache::stat_frees
+    Number of objects returned.
+ @var slab_cache::stat_fails
+    Number of allocations that failed for lack of memory.
+ @var slab_cache::stat_slabs
+    Number of slabs currently held.
+ @var slab_cache::stat_objs
+    Number of objects in the held slabs, in use or free.
+ @var slab_cache::stat_in_use
+    Number of objects currently handed out.
+*/
+struct slab_cache {
+    const char* name;
+    size_t obj_size;
+    int (*ctor)(void* obj);
+    void (*dtor)(void* obj);
+    struct slab* slabs_partial;
+    struct slab* slabs_full;
+    size_t objs_min;
+    struct slab_cache* p_next;
+    uint32_t stat_allocs;
+    uint32_t stat_frees;
+    uint32_t stat_fails;
+    uint32_t stat_slabs;
+    uint32_t stat_objs;
+    uint32_t stat_in_use;
+};
+
+/**
+ Statically initializes a cache for objects of a type.
+ @param cache_name Name of the cache
+ @param type Type of the cached objects
+ @param ctor_fn Constructor, or NULL
+ @param dtor_fn Destructor, or NULL
+*/
+#define SLAB_CACHE_INIT(cache_name, type, ctor_fn, dtor_fn) \
+    { (cache_name), sizeof(type), (ctor_fn), (dtor_fn), NULL, NULL, 0, NULL, 0, 0, 0, 0, 0, 0 }
+
+/**
+ @brief
+    Takes a free object from a cache, growing the cache by a slab if it has none.
+ @param cache
+    The cache to allocate from.
+ @return
+    A constructed object, NULL if no slab could be created.
+*/
+void* slab_alloc(struct slab_cache* cache);
+
+/**
+ @brief
+    Returns an object to the cache it was allocated from. A slab left with no
+    objects in use is released, unless the cache needs it to keep objs_min objects.
+ @param cache
+    The cache the object was allocated from.
+ @param obj
+    The object to return.
+*/
+void slab_free(struct slab_cache* cache, void* obj);
+
+/**
+ @brief
+    Grows a cache until it holds at least a number of objects, and keeps at least
+    that many from then on.
+ @param cache
+    The cache to grow.
+ @param count
+    The number of objects to hold.
+ @return
+    0 on success, a negative value if a slab could not be created.
+*/
+int slab_reserve(struct slab_cache* cache, size_t count);
+
+/**
+ @brief
+    Gets the first of all caches that have been used, for listing statistics.
+ @return
+    The first cache, NULL if no cache has been used.
+*/
+struct slab_cache* slab_cache_first(void);
+
+#endif // MPX_SLAB_H
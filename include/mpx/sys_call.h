@@ -1,7 +1,28 @@
 #ifndef MPX_SYS_CALL_H
 #define MPX_SYS_CALL_H
 
+#include <stdint.h>
 #include <mpx/context.h>
+#include <mpx/sys_req.h>
+
+/**
+ @brief
+    Non-zero once SYSENTER fast system call entry is enabled. sys_req then uses
+    SYSENTER in place of int 0x60.
+*/
+extern unsigned char sys_call_fast;
+
+/** An op code no request uses, so sys_call() only enters and leaves the kernel. */
+#define SYS_CALL_NULL_OP ((op_code)-1)
+
+/**
+ @brief
+    Checks all serial devices for completed I/O operations, moving the requesting
+    processes back to the ready state.
+ @return
+    Non-zero if at least one process was made ready, 0 otherwise.
+*/
+unsigned char sys_check_io(void);
 
 /**
  @brief
@@ -14,4 +35,26 @@
 */
 struct context* sys_call(struct context* context_in);
 
+/**
+ @brief
+    Enables SYSENTER fast system call entry if the CPU supports it. int 0x60
+    remains installed and is used when this fails.
+ @return
+    0 on success, a negative value if SYSENTER is unsupported.
+*/
+int sys_call_fast_init(void);
+
+/**
+ @brief
+    Measures the average cost of a null system call, one that does no work
+    besides entering and leaving the kernel. Must be called outside of a process.
+ @param fast
+    Non-zero to measure SYSENTER entry, 0 to measure int 0x60 entry.
+ @param iterations
+    The number of null system calls to average over.
+ @return
+    The average number of TSC cycles per null system call.
+*/
+uint32_t sys_call_null_cycles(unsigned char fast, unsigned int iterations);
+
 #endif // MPX_SYS_CALL_H
@@ -13,6 +13,8 @@ typedef enum {
 	IDLE,
 	READ,
 	WRITE,
+	SLEEP,
+	SLEEP_UNTIL,
 } op_code;
     
 // error codes
@@ -22,8 +24,9 @@ typedef enum {
 
 /**
  Request an MPX kernel operation.
- @param op_code One of READ, WRITE, IDLE, or EXIT
- @param ... As required for READ or WRITE
+ @param op_code One of READ, WRITE, IDLE, EXIT, SLEEP, or SLEEP_UNTIL
+ @param ... As required for READ or WRITE, or an unsigned tick count for
+            SLEEP (ticks to sleep for) and SLEEP_UNTIL (tick to sleep until)
  @return Varies by operation
 */ 
 int sys_req(op_code op, ...);
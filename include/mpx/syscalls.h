@@ -46,6 +46,16 @@ int read(device dev, const void* buffer_inout, size_t buffer_inout_sz);
 */
 int idle();
 
+/**
+@brief
+    Alias for sys_req(SLEEP).
+@param ticks
+    Number of timer ticks (milliseconds) to block the calling process for.
+@return
+    A status code corresponding to the result of sys_req(SLEEP).
+*/
+int sleep(unsigned int ticks);
+
 /**
 @brief
     Alias for sys_req(EXIT).
@@ -0,0 +1,132 @@
+#ifndef MPX_TIMER_H
+#define MPX_TIMER_H
+
+#include <stdint.h>
+#include <mpx/context.h>
+
+/**
+ @file mpx/timer.h
+ @brief PIT driven system timer, preemptive time slicing and sleeping
+*/
+
+/** Input clock of the programmable interval timer, in Hz. */
+#define TIMER_PIT_BASE_HZ (1193182)
+
+/** Rate the PIT is programmed to interrupt at, in Hz (one tick per millisecond). */
+#define TIMER_TICK_HZ (1000)
+
+/** Default time slice given to a process, in ticks. */
+#define TIMER_QUANTUM_DEFAULT (10)
+
+/** Bounds for the time slice given to a process, in ticks. */
+#define TIMER_QUANTUM_MIN (1)
+#define TIMER_QUANTUM_MAX (1000)
+
+/**
+ @var timer_ticks
+ @brief
+    Number of PIT ticks elapsed since timer_init().
+*/
+extern volatile uint32_t timer_ticks;
+
+/**
+ @var preempt_depth
+ @brief
+    Nesting depth of preempt_disable(). The running process is only preempted
+    while this is zero.
+*/
+extern volatile unsigned int preempt_depth;
+
+/**
+ @brief
+    Prevents the timer from preempting the running process, e.g, while it is
+    modifying kernel structures shared with the scheduler. May be nested, but
+    must not be held across a sys_req().
+*/
+#define preempt_disable() (++preempt_depth)
+
+/**
+ @brief
+    Reverses a single preempt_disable().
+*/
+#define preempt_enable() (--preempt_depth)
+
+/**
+ @brief
+    Programs PIT channel 0 to interrupt at TIMER_TICK_HZ, installs the timer
+    interrupt service routine on IRQ0, and unmasks IRQ0.
+*/
+void timer_init(void);
+
+/**
+ @brief
+    Gets the time slice given to each process before it is rotated out in
+    favor of a ready process of the same priority.
+ @return
+    The current quantum, in ticks.
+*/
+unsigned int timer_get_quantum(void);
+
+/**
+ @brief
+    Sets the time slice given to each process.
+ @param ticks
+    New quantum in ticks. Must be within [TIMER_QUANTUM_MIN, TIMER_QUANTUM_MAX].
+ @return
+    0 on success, a negative value if the quantum is out of range.
+*/
+int timer_set_quantum(unsigned int ticks);
+
+/**
+ @brief
+    Handler called by timer_isr on every PIT tick. Advances the timer wheel to
+    wake sleeping processes whose deadline has passed, completes any finished
+    I/O, and preempts the running process once its quantum expires, or
+    immediately if a higher priority process is ready.
+ @param context_in
+    A pointer to the context of the interrupted process pushed by timer_isr.
+ @return
+    A pointer to a different context to switch to, or NULL to resume the
+    interrupted context.
+*/
+struct context* timer_interrupt(struct context* context_in);
+
+struct pcb;
+
+/**
+ @brief
+    Parks a process on the timer wheel so that it is made ready once the given
+    tick is reached. The caller is responsible for blocking the process.
+ @param pcb
+    The process to wake at the deadline. Must not already be sleeping.
+ @param deadline
+    The value of timer_ticks at which to wake the process.
+*/
+void timer_sleep_until(struct pcb* pcb, uint32_t deadline);
+
+/**
+ @brief
+    Takes a process off the timer wheel without waking it. Does nothing if the
+    process is not sleeping.
+ @param pcb
+    The process to cancel the pending wake up for.
+*/
+void timer_cancel(struct pcb* pcb);
+
+/**
+ @brief
+    Wakes a sleeping process before its deadline, as if the deadline had passed.
+    Does nothing if the process is not sleeping.
+ @param pcb
+    The process to make ready.
+*/
+void timer_wake(struct pcb* pcb);
+
+/**
+ @brief
+    Timer interrupt service routine. Saves a context as sys_call_isr does and
+    calls timer_interrupt().
+*/
+extern void timer_isr(void*);
+
+#endif // MPX_TIMER_H
@@ -0,0 +1,22 @@
+#ifndef MPX_TSC_H
+#define MPX_TSC_H
+
+#include <stdint.h>
+
+/**
+ @file mpx/tsc.h
+ @brief Access to the processor's time stamp counter
+*/
+
+/**
+ Read the time stamp counter
+ @return The number of cycles counted since processor reset
+*/
+static inline uint64_t rdtsc(void)
+{
+	uint32_t lo, hi;
+	__asm__ volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t) hi << 32) | lo;
+}
+
+#endif
@@ -7,6 +7,16 @@
 */
 
 #include <stddef.h>
+#include <stdint.h>
+
+/** Size of a page of virtual memory. */
+#define VM_PAGE_SIZE	0x1000
+
+/** Start of the virtual range reserved for the growable MPX heap. */
+#define VM_HEAP_BASE	0xE000000
+
+/** Size of the virtual range reserved for the growable MPX heap. */
+#define VM_HEAP_MAX	0x1000000
 
 /**
  Allocates memory from a primitive heap.
@@ -18,11 +28,84 @@
  */
 void *kmalloc(size_t size, int align, void **phys_addr);
 
+/** Largest order of a block of frames, i.e. 2^10 frames or 4 MiB. */
+#define FRAME_ORDER_MAX	10
+
+/**
+ Allocates a naturally aligned block of contiguous physical frames from the
+ buddy allocator in O(log n).
+ @param order The block spans 2^order frames, at most FRAME_ORDER_MAX
+ @return The physical address of the block, 0 if no block is available
+*/
+uintptr_t frame_alloc(unsigned int order);
+
+/**
+ Returns a block of frames to the buddy allocator, merging it with its free
+ buddies.
+ @param phys The physical address returned by frame_alloc()
+ @param order The order the block was allocated with
+*/
+void frame_free(uintptr_t phys, unsigned int order);
+
+/**
+ Gets the number of physical frames up to the end of available memory.
+ @return The number of frames, including reserved ones
+*/
+size_t frame_total_count(void);
+
+/**
+ Gets the number of free physical frames, without scanning.
+ @return The number of free frames
+*/
+size_t frame_free_count(void);
+
+/**
+ Maps fresh physical frames at a range of kernel virtual pages.
+ @param vaddr The page aligned start of the range, within VM_HEAP_BASE
+              and VM_HEAP_BASE + VM_HEAP_MAX
+ @param pages The number of pages to map
+ @return 0 on success, -1 if a page is already mapped or no frames are
+         left, in which case nothing is mapped
+*/
+int vm_map(void *vaddr, size_t pages);
+
+/**
+ Unmaps a range of kernel virtual pages and returns their frames.
+ @param vaddr The page aligned start of the range
+ @param pages The number of pages to unmap
+*/
+void vm_unmap(void *vaddr, size_t pages);
+
+/**
+ Registers a range of kernel virtual pages to be backed on demand. A page of
+ the range is mapped to a zero-filled frame the first time it is touched, so
+ only touched pages use memory. Other page faults panic with their address.
+ @param base The page aligned start of the range
+ @param size The page aligned size of the range, whose page tables must
+             already exist, as they do within VM_HEAP_BASE and
+             VM_HEAP_BASE + VM_HEAP_MAX
+ @return 0 on success, -1 if the range cannot be backed on demand
+*/
+int vm_region_add(void *base, size_t size);
+
+/**
+ Unregisters a range registered by vm_region_add() and unmaps its pages.
+ @param base The start of the range
+ @return 0 on success, -1 if no range starts at base
+*/
+int vm_region_remove(void *base);
+
+struct multiboot_info;
+
 /**
  Initializes the kernel page directory and initial kernel heap area.
  Performs identity mapping of the kernel frames such that the virtual
  addresses are equivalent to the physical addresses.
+ @param mbi The multiboot information the kernel was booted with, or NULL.
+            The frame allocator is sized from its memory map, and ranges it
+            does not report as available are never allocated. Without one,
+            64 MB of memory is assumed.
 */
-void vm_init(void);
+void vm_init(const struct multiboot_info *mbi);
 
 #endif
@@ -2,6 +2,7 @@
 #define MPX_STRING_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 /**
  @file string.h
@@ -49,4 +50,22 @@ char* strtok(char * restrict s1, const char * restrict s2);
 
 void itoa(char string[], int integer);
 
+/**
+ Convert an unsigned 64-bit integer to a decimal string without 64-bit division
+ @param string Buffer of at least 21 bytes receiving the NUL-terminated digits
+ @param integer The value to convert
+*/
+void u64toa(char string[], uint64_t integer);
+
+/**
+ Appends a string to a buffer being built up, truncating at the end of the buffer.
+ The result is not NUL-terminated.
+ @param buf The buffer to append to
+ @param len The number of bytes already in the buffer
+ @param sz The size of the buffer
+ @param str A NUL-terminated string to append
+ @return The number of bytes in the buffer after appending
+*/
+size_t strappend(char *buf, size_t len, size_t sz, const char *str);
+
 #endif
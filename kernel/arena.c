@@ -0,0 +1,90 @@
+#include <mpx/arena.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mpx/memory.h>
+#include <mpx/vm.h>
+
+
+// header of a chunk, followed by the memory it hands out
+struct arena_chunk {
+    struct arena_chunk* p_next;
+    uintptr_t end;
+};
+
+#define ARENA_ALIGN (sizeof(void*))
+#define ARENA_ROUND_UP(size) (((size) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+// every allocation is preceded by a word derived from its address, cleared once freed
+#define ARENA_MAGIC (0x4152454Eu)
+#define ARENA_CHECK(ptr) ((uintptr_t)(ptr) ^ ARENA_MAGIC)
+#define ARENA_HDR(ptr) (((uintptr_t*)(ptr)) - 1)
+
+void* arena_alloc(struct arena* arena, size_t size)
+{
+    // no chunk can exceed the heap, and this keeps the sizes below from overflowing
+    if (size > VM_HEAP_MAX)
+    {
+        return NULL;
+    }
+    size = ((size == 0) ? ARENA_ALIGN : ARENA_ROUND_UP(size)) + ARENA_ALIGN;
+    if (size > arena->end - arena->bump)
+    {
+        size_t chunk_size = sizeof(struct arena_chunk) + size;
+        if (chunk_size < MPX_ARENA_CHUNK_SZ)
+        {
+            chunk_size = MPX_ARENA_CHUNK_SZ;
+        }
+        struct arena_chunk* chunk = allocate_memory(chunk_size);
+        if (chunk == NULL)
+        {
+            return NULL;
+        }
+        chunk->end = (uintptr_t)chunk + chunk_size;
+        chunk->p_next = arena->chunks;
+        arena->chunks = chunk;
+        // whatever is left of the previous chunk is abandoned until the arena is released
+        arena->bump = (uintptr_t)(chunk + 1);
+        arena->end = chunk->end;
+    }
+    void* ptr = (void*)(arena->bump + ARENA_ALIGN);
+    *ARENA_HDR(ptr) = ARENA_CHECK(ptr);
+    arena->bump += size;
+    return ptr;
+}
+
+int arena_free(void* ptr)
+{
+    if (((uintptr_t)ptr & (ARENA_ALIGN - 1)) || (*ARENA_HDR(ptr) != ARENA_CHECK(ptr)))
+    {
+        return -1;
+    }
+    *ARENA_HDR(ptr) = 0;
+    return 0;
+}
+
+int arena_owns(const struct arena* arena, const void* ptr)
+{
+    for (const struct arena_chunk* chunk = arena->chunks; chunk != NULL; chunk = chunk->p_next)
+    {
+        if (((uintptr_t)ptr >= (uintptr_t)(chunk + 1)) && ((uintptr_t)ptr < chunk->end))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void arena_release(struct arena* arena)
+{
+    struct arena_chunk* chunk = arena->chunks;
+    while (chunk != NULL)
+    {
+        struct arena_chunk* next = chunk->p_next;
+        free_memory(chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+    arena->bump = 0;
+    arena->end = 0;
+}
@@ -0,0 +1,231 @@
+#include <mpx/bench.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <mpx/pcb.h>
+#include <mpx/sys_req.h>
+#include <mpx/sys_call.h>
+#include <mpx/syscalls.h>
+#include <mpx/timer.h>
+#include <mpx/tsc.h>
+#include <mpx/memory.h>
+
+
+#define BENCH_PINGPONG_PRI (0)
+// longest the ping-pong caller sleeps between checks, should the pair exit just before it sleeps
+#define BENCH_PINGPONG_WAIT_TICKS (1000)
+// queue the PCB insert/remove benchmark fills, never dispatched from
+#define BENCH_QUEUE_STATE { PCB_EXEC_READY, PCB_DPATCH_SUSPENDED, PCB_CLASS_USER, 0 }
+
+static uint32_t bench_samples[MPX_BENCH_SAMPLES];
+
+static volatile unsigned char bench_ping_done = 0;
+static volatile unsigned char bench_pingpong_exited = 0;
+static struct pcb* bench_pingpong_waiter = NULL;
+
+static void bench_sort(uint32_t* samples, size_t count)
+{
+    for (size_t i = 1; i < count; ++i)
+    {
+        uint32_t sample = samples[i];
+        size_t j = i;
+        while ((j > 0) && (samples[j - 1] > sample))
+        {
+            samples[j] = samples[j - 1];
+            --j;
+        }
+        samples[j] = sample;
+    }
+}
+
+static size_t bench_append_num(char* line, size_t len, size_t sz, const char* key, uint32_t value)
+{
+    char num[21];
+    u64toa(num, value);
+    len = strappend(line, len, sz, key);
+    return strappend(line, len, sz, num);
+}
+
+// sorts the samples and writes their summary as a single line
+static void bench_report(device dev, const char* name, int depth, size_t count)
+{
+    char line[160];
+    size_t len = 0;
+    const size_t sz = sizeof(line);
+
+    bench_sort(bench_samples, count);
+    len = strappend(line, len, sz, "bench name=");
+    len = strappend(line, len, sz, name);
+    if (depth >= 0)
+    {
+        len = bench_append_num(line, len, sz, " depth=", (uint32_t)depth);
+    }
+    len = bench_append_num(line, len, sz, " n=", count);
+    len = bench_append_num(line, len, sz, " min=", bench_samples[0]);
+    len = bench_append_num(line, len, sz, " median=", bench_samples[count / 2]);
+    len = bench_append_num(line, len, sz, " p99=", bench_samples[(count * 99) / 100]);
+    len = bench_append_num(line, len, sz, " max=", bench_samples[count - 1]);
+    len = strappend(line, len, sz, "\r\n");
+    write(dev, line, len);
+}
+
+static void bench_null_sys_req(device dev)
+{
+    for (size_t i = 0; i < MPX_BENCH_SAMPLES; ++i)
+    {
+        uint32_t start = (uint32_t)rdtsc();
+        sys_req(SYS_CALL_NULL_OP);
+        bench_samples[i] = (uint32_t)rdtsc() - start;
+    }
+    bench_report(dev, "null_sys_req", -1, MPX_BENCH_SAMPLES);
+}
+
+// counts a helper out, the second one to exit wakes the process waiting for the pair
+static void bench_pingpong_exit(void)
+{
+    if (++bench_pingpong_exited == 2)
+    {
+        timer_wake(bench_pingpong_waiter);
+    }
+    sys_req(EXIT);
+}
+
+// times round trips of IDLE, each a switch to bench_pong and back
+static void bench_ping(void)
+{
+    for (size_t i = 0; i < MPX_BENCH_SAMPLES; ++i)
+    {
+        uint32_t start = (uint32_t)rdtsc();
+        sys_req(IDLE);
+        bench_samples[i] = (uint32_t)rdtsc() - start;
+    }
+    bench_ping_done = 1;
+    bench_pingpong_exit();
+}
+
+static void bench_pong(void)
+{
+    while (!bench_ping_done)
+    {
+        sys_req(IDLE);
+    }
+    bench_pingpong_exit();
+}
+
+static int bench_idle_pingpong(device dev)
+{
+    struct pcb* ping = pcb_setup("bench_ping", PCB_CLASS_SYSTEM, BENCH_PINGPONG_PRI);
+    struct pcb* pong = pcb_setup("bench_pong", PCB_CLASS_SYSTEM, BENCH_PINGPONG_PRI);
+    if ((ping == NULL) || (pong == NULL))
+    {
+        if (ping != NULL)
+        {
+            pcb_free(ping);
+        }
+        if (pong != NULL)
+        {
+            pcb_free(pong);
+        }
+        return -1;
+    }
+    pcb_context_init(ping, bench_ping, NULL, 0);
+    pcb_context_init(pong, bench_pong, NULL, 0);
+    bench_ping_done = 0;
+    bench_pingpong_exited = 0;
+    bench_pingpong_waiter = pcb_running;
+    pcb_insert(ping);
+    pcb_insert(pong);
+    // stay asleep until the second of the pair exits, so only they switch between each other
+    while (bench_pingpong_exited < 2)
+    {
+        sleep(BENCH_PINGPONG_WAIT_TICKS);
+    }
+    bench_report(dev, "idle_pingpong", -1, MPX_BENCH_SAMPLES);
+    return 0;
+}
+
+// times inserting a PCB behind depth - 1 queued PCBs and removing it again
+static int bench_queue_depth(device dev, int depth)
+{
+    // filler PCBs, only their queue linkage is used, held only while this runs
+    struct pcb* bench_queue_pcbs = allocate_memory((size_t)depth * sizeof(struct pcb));
+    if (bench_queue_pcbs == NULL)
+    {
+        return -1;
+    }
+    const struct pcb_state state = BENCH_QUEUE_STATE;
+    for (int i = 0; i < depth; ++i)
+    {
+        struct pcb* pcb = &bench_queue_pcbs[i];
+        memset(pcb, 0, sizeof(*pcb));
+        pcb->state = state;
+        pcb->state.pri = i % (MPX_PCB_PROCPRI_MAX + 1);
+    }
+    for (int i = 0; i < depth - 1; ++i)
+    {
+        pcb_insert(&bench_queue_pcbs[i]);
+    }
+    struct pcb* timed = &bench_queue_pcbs[depth - 1];
+    for (size_t i = 0; i < MPX_BENCH_SAMPLES; ++i)
+    {
+        uint32_t start = (uint32_t)rdtsc();
+        pcb_insert(timed);
+        pcb_remove(timed);
+        bench_samples[i] = (uint32_t)rdtsc() - start;
+    }
+    for (int i = 0; i < depth - 1; ++i)
+    {
+        pcb_remove(&bench_queue_pcbs[i]);
+    }
+    free_memory(bench_queue_pcbs);
+    bench_report(dev, "pcb_insert_remove", depth, MPX_BENCH_SAMPLES);
+    return 0;
+}
+
+static int bench_setup_free(device dev)
+{
+    for (size_t i = 0; i < MPX_BENCH_SAMPLES; ++i)
+    {
+        uint32_t start = (uint32_t)rdtsc();
+        struct pcb* pcb = pcb_setup("bench_setup", PCB_CLASS_USER, MPX_PCB_PROCPRI_MAX);
+        if (pcb == NULL)
+        {
+            return -1;
+        }
+        pcb_free(pcb);
+        bench_samples[i] = (uint32_t)rdtsc() - start;
+    }
+    bench_report(dev, "pcb_setup_free", -1, MPX_BENCH_SAMPLES);
+    return 0;
+}
+
+int bench_run(device dev)
+{
+    int ret = 0;
+    bench_null_sys_req(dev);
+    if (bench_idle_pingpong(dev) != 0)
+    {
+        write(dev, STR_BUF("bench name=idle_pingpong error=setup\r\n"));
+        ret = -1;
+    }
+    for (int depth = 1; depth <= MPX_BENCH_QUEUE_DEPTH_MAX; depth *= 10)
+    {
+        if (bench_queue_depth(dev, depth) != 0)
+        {
+            write(dev, STR_BUF("bench name=pcb_insert_remove error=setup\r\n"));
+            ret = -1;
+        }
+    }
+    if (bench_setup_free(dev) != 0)
+    {
+        write(dev, STR_BUF("bench name=pcb_setup_free error=setup\r\n"));
+        ret = -1;
+    }
+    return ret;
+}
+
+void bench_process(void)
+{
+    bench_run(COM1);
+    sys_req(EXIT);
+}
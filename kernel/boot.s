@@ -22,6 +22,8 @@ multiboot_header:
 ;; kernel entry point
 start:
 	mov esp, stack + STACKSIZE	;; establish a stack
+	push ebx			;; multiboot information
+	push eax			;; multiboot magic
 	call kmain			;; jump to C code
 
 	cli				;; disable interrupts
@@ -13,6 +13,9 @@
 #include <memory.h>
 #include <ctype.h>
 #include <mpx/memory.h>
+#include <mpx/timer.h>
+#include <mpx/bench.h>
+#include <mpx/slab.h>
 
 struct str_pcbprop_map {
     const char prop;
@@ -48,6 +51,15 @@ const char* dpatchstate_str(enum ProcDispatchState state) {
     return avail_pcb_dpatchstate[state].str_out;
 }
 
+// finds a process by name, or failing that, by PID if the input is numeric
+struct pcb* pcb_find_input(const char* input, size_t input_len) {
+    struct pcb* procfound = pcb_find(input);
+    if ((procfound == NULL) && (input_len > 0) && (input_len <= 9) && intParsable(input, input_len)) {
+        procfound = pcb_find_pid((unsigned int) atoi(input));
+    }
+    return procfound;
+}
+
 int helpCommand();
 int setTimeCommand();
 int getTimeCommand();
@@ -69,6 +81,13 @@ int allocateMemoryCommand();
 int freeMemoryCommand();
 int showAllocatedMemoryCommand();
 int showFreeMemoryCommand();
+int quantumCommand();
+int benchmarkCommand();
+int showCachesCommand();
+int heapTraceCommand();
+int heapStatsCommand();
+int allocProfileCommand();
+int serialStatsCommand();
 
 const struct cmd_entry
 {
@@ -151,7 +170,7 @@ cmd_entries[] =
         STR_BUF(
         "Set PCB Priority\r\n"
 		    "\tInput:\r\n"
-            "\tprocess name - corresponding name of the new process\r\n"
+            "\tprocess name or PID - name or PID of an existing process\r\n"
             "\tprocess priority - base priority of the new process\r\n"
 		    "\tOutput:\r\n"
 		    "\tno output\r\n"
@@ -163,11 +182,13 @@ cmd_entries[] =
         STR_BUF(
         "Show PCB\r\n"
             "\tInput:\r\n"
-            "\tName of Process\r\n"
+            "\tName or PID of Process\r\n"
             "\tOutput:\r\n"
             "\tInformation on found process\r\n"
             "\tDescription:\r\n"
-            "\tPrints the name, class, state, suspended status, and priority of the given process\r\n"
+            "\tPrints the name, PID, class, state, suspended status, and priority of the given process,\r\n"
+            "\tfollowed by its dispatch count, cycles spent running, ready and blocked, system calls\r\n"
+            "\tissued by type, and bytes read and written\r\n"
         )
     },
     { STR_BUF("8"), STR_BUF("Show Ready PCBs"), showPcbReadyCommand,
@@ -178,7 +199,7 @@ cmd_entries[] =
             "\tOutput:\r\n"
             "\tInformation on all ready PCBs\r\n"
             "\tDescription:\r\n"
-            "\tPrints the name, class, state, suspended status, and priority of all ready PCBs\r\n"
+            "\tPrints the name, PID, class, state, suspended status, and priority of all ready PCBs\r\n"
         )
     },
     { STR_BUF("9"), STR_BUF("Show Blocked PCBs"), showPcbBlockedCommand,
@@ -189,7 +210,7 @@ cmd_entries[] =
             "\tOutput:\r\n"
             "\tInformation on all Blocked PCBs\r\n"
             "\tDescription:\r\n"
-            "\tPrints the name, class, state, suspended status, and priority of all blocked PCBs\r\n"
+            "\tPrints the name, PID, class, state, suspended status, and priority of all blocked PCBs\r\n"
         )
     },
     { STR_BUF("10"), STR_BUF("Show All PCBs"), showPcbAllCommand,
@@ -200,25 +221,25 @@ cmd_entries[] =
             "\tOutput:\r\n"
             "\tInformation on all PCBs\r\n"
             "\tDescription:\r\n"
-            "\tPrints the name, class, state, suspended status, and priority of all PCBs\r\n"
+            "\tPrints the name, PID, class, state, suspended status, and priority of all PCBs\r\n"
         )
     },
     { STR_BUF("11"), STR_BUF("Delete PCB"), deletePcbCommand,
         STR_BUF(
         "Delete PCB\r\n"
             "\tInput:\r\n"
-            "\tName of Process\r\n"
+            "\tName or PID of Process\r\n"
             "\tOutput:\r\n"
             "\tNo output\r\n"
             "\tDescription:\r\n"
-            "\tDeletes the PCB and frees associated memory of given PCB name if found\r\n"
+            "\tDeletes the PCB and frees associated memory of given PCB name or PID if found\r\n"
         )
     },
     { STR_BUF("12"), STR_BUF("Suspend PCB"), suspendPcbCommand,
         STR_BUF(
         "Suspend PCB\r\n"
             "\tInput:\r\n"
-            "\tName of Process \r\n"
+            "\tName or PID of Process\r\n"
             "\tOutput: \r\n"
             "\tNo output\r\n"
             "\tDescription:\r\n"
@@ -229,7 +250,7 @@ cmd_entries[] =
         STR_BUF(
         "Resume PCB\r\n"
             "\tInput:\r\n"
-            "\tName of Process\r\n"
+            "\tName or PID of Process\r\n"
             "\tOutput:\r\n"
             "\tNo output\r\n"
             "\tDescription:\r\n"
@@ -324,6 +345,94 @@ cmd_entries[] =
             "\tDescription:\r\n"
             "\tShow the list of allocated memory blocks in the heap.\r\n"
         )
+    },
+    { STR_BUF("22"), STR_BUF("Quantum"), quantumCommand,
+        STR_BUF(
+        "Quantum\r\n"
+            "\tInput:\r\n"
+            "\tA new time slice in milliseconds (1-1000), or nothing to keep the current one.\r\n"
+            "\tResult:\r\n"
+            "\tThe time slice is shown and changed if a new one was given.\r\n"
+            "\tDescription:\r\n"
+            "\tShows or sets how long a process runs before being rotated out in favor\r\n"
+            "\tof a ready process of the same priority.\r\n"
+        )
+    },
+    { STR_BUF("23"), STR_BUF("Benchmark"), benchmarkCommand,
+        STR_BUF(
+        "Benchmark\r\n"
+            "\tInput:\r\n"
+            "\tNone\r\n"
+            "\tResult:\r\n"
+            "\tOne line per benchmark with the min, median, p99 and max cost in TSC cycles.\r\n"
+            "\tDescription:\r\n"
+            "\tMeasures a null system call, an IDLE ping-pong between two processes, PCB\r\n"
+            "\tqueue insertion and removal at depths 1 to 1000, and PCB setup and free.\r\n"
+        )
+    },
+    { STR_BUF("24"), STR_BUF("Show Caches"), showCachesCommand,
+        STR_BUF(
+        "Show Caches\r\n"
+            "\tInput:\r\n"
+            "\tNone\r\n"
+            "\tResult:\r\n"
+            "\tOne line per object cache with its object size and statistics.\r\n"
+            "\tDescription:\r\n"
+            "\tShows, for each kernel object cache, the slabs and objects it holds, the\r\n"
+            "\tobjects in use, and the allocations, frees and failed allocations so far.\r\n"
+        )
+    },
+    { STR_BUF("25"), STR_BUF("Heap Trace"), heapTraceCommand,
+        STR_BUF(
+        "Heap Trace\r\n"
+            "\tInput:\r\n"
+            "\tNone\r\n"
+            "\tResult:\r\n"
+            "\tOne line per recent heap operation with its size, pointer and TSC.\r\n"
+            "\tDescription:\r\n"
+            "\tDumps the most recent heap allocations and frees, for replay on the host\r\n"
+            "\twith the heap-replay tool. Requires a kernel built with HEAP_TRACE=1.\r\n"
+        )
+    },
+    { STR_BUF("26"), STR_BUF("Heap Stats"), heapStatsCommand,
+        STR_BUF(
+        "Heap Stats\r\n"
+            "\tInput:\r\n"
+            "\tNone\r\n"
+            "\tResult:\r\n"
+            "\tA summary of heap utilization and fragmentation.\r\n"
+            "\tDescription:\r\n"
+            "\tShows the bytes and blocks in use and free, the largest free block, the\r\n"
+            "\tshare of free memory outside it, allocation and free counts, and a\r\n"
+            "\thistogram of requested allocation sizes.\r\n"
+        )
+    },
+    { STR_BUF("27"), STR_BUF("Alloc Profile"), allocProfileCommand,
+        STR_BUF(
+        "Alloc Profile\r\n"
+            "\tInput:\r\n"
+            "\tNone\r\n"
+            "\tResult:\r\n"
+            "\tOne line per allocation site and process, largest live bytes first.\r\n"
+            "\tDescription:\r\n"
+            "\tShows who holds heap memory: the return address of each allocating call,\r\n"
+            "\tthe process it was made for, the bytes and blocks still allocated, and\r\n"
+            "\tthe allocations made. Requires a kernel built with HEAP_PROFILE=1.\r\n"
+        )
+    },
+    { STR_BUF("28"), STR_BUF("Serial Stats"), serialStatsCommand,
+        STR_BUF(
+        "Serial Stats\r\n"
+            "\tInput:\r\n"
+            "\tNone\r\n"
+            "\tResult:\r\n"
+            "\tTwo lines per open serial port with its transmit and receive statistics.\r\n"
+            "\tDescription:\r\n"
+            "\tShows the transmit FIFO size detected for each open port, the transmit\r\n"
+            "\tinterrupts and bytes so far, and the bytes sent per interrupt. Likewise\r\n"
+            "\tshows the receive trigger level, the receive interrupts and bytes, the\r\n"
+            "\tbytes taken per interrupt, and how often the receive FIFO overran.\r\n"
+        )
     }
     
 };
@@ -533,7 +642,7 @@ int setPcbPriorityCommand() {
 
     struct pcb* pcb_findres;
     while(1) {
-        static const char name_msg[] = "Enter the name of an existing process to change its priority:\r\n";
+        static const char name_msg[] = "Enter the name or PID of an existing process to change its priority:\r\n";
                                       
         setTerminalColor(Yellow);
         write(COM1, STR_BUF(name_msg));
@@ -543,12 +652,12 @@ int setPcbPriorityCommand() {
         if ((user_input_len > 0) && (user_input_len <= MPX_PCB_PROCNAME_SZ))
         {
             memcpy(proc_name, user_input, user_input_len + 1);
-            pcb_findres = pcb_find(proc_name);
+            pcb_findres = pcb_find_input(proc_name, user_input_len);
             user_input_clear();
             if (pcb_findres == NULL)
             {
                 setTerminalColor(Red);
-                static const char find_error_msg[] = "Process name does not exist.\r\n";
+                static const char find_error_msg[] = "Process name or PID does not exist.\r\n";
                 write(COM1, STR_BUF(find_error_msg));
                 continue;
             }
@@ -574,9 +683,11 @@ int setPcbPriorityCommand() {
                 proc_pri = atoi(user_input);
                 if ((proc_pri >= 0) && (proc_pri <= MPX_PCB_PROCPRI_MAX))
                 {
+                    preempt_disable();
                     pcb_remove(pcb_findres);
                     pcb_findres->state.pri = (unsigned char) proc_pri;
                     pcb_insert(pcb_findres);
+                    preempt_enable();
                     user_input_clear();
                     break;
                 }
@@ -629,13 +740,13 @@ int helpCommand() {
 
 int showPcbCommand(){
     setTerminalColor(Yellow);
-    const char msg[] = "Enter the name of an existing process:\r\n";
+    const char msg[] = "Enter the name or PID of an existing process:\r\n";
     write(COM1, STR_BUF(msg));
 
     setTerminalColor(White);
     user_input_promptread();
     
-    struct pcb* procfound = pcb_find(user_input);
+    struct pcb* procfound = pcb_find_input(user_input, user_input_len);
     user_input_clear();
     if (procfound == NULL){
         setTerminalColor(Red);
@@ -645,6 +756,7 @@ int showPcbCommand(){
     }
     
     const char msgName[] = "\r\nProcess Name: ";
+    const char msgPid[] = "\r\nProcess PID: ";
     const char msgClass[] = "\r\nProcess Class: ";
     const char msgPri[] = "\r\nProcess Priority: ";
     const char msgState[] = "\r\nProcess State: ";
@@ -655,10 +767,14 @@ int showPcbCommand(){
     const char* charStatus = dpatchstate_str(procfound->state.dpatch);
     char charPri[4]; 
     itoa(charPri, (int) procfound->state.pri);
+    char charPid[12];
+    itoa(charPid, (int) procfound->pid);
 
     setTerminalColor(Yellow);
     write(COM1, STR_BUF(msgName));
     write(COM1, DSTR_BUF(procfound->name));
+    write(COM1, STR_BUF(msgPid));
+    write(COM1, DSTR_BUF(charPid));
     write(COM1, STR_BUF(msgClass));
     write(COM1, DSTR_BUF(charClass));
     write(COM1, STR_BUF(msgPri));
@@ -667,19 +783,60 @@ int showPcbCommand(){
     write(COM1, DSTR_BUF(charState));
     write(COM1, STR_BUF(msgStatus));
     write(COM1, DSTR_BUF(charStatus));
+
+    // snapshot the accounting with the time in the current state charged
+    preempt_disable();
+    pcb_acct_update(procfound);
+    struct pcb_acct acct = procfound->acct;
+    preempt_enable();
+
+    const char* const acctLabels[] = {
+        "\r\nDispatches: ",
+        "\r\nRun Cycles: ",
+        "\r\nReady Cycles: ",
+        "\r\nBlocked Cycles: ",
+        "\r\nBytes Read: ",
+        "\r\nBytes Written: ",
+    };
+    const uint64_t acctValues[] = {
+        acct.dispatches,
+        acct.run_cycles,
+        acct.ready_cycles,
+        acct.blocked_cycles,
+        acct.bytes_read,
+        acct.bytes_written,
+    };
+    char charAcct[21];
+    for (size_t i = 0; i < sizeof(acctValues) / sizeof(acctValues[0]); ++i)
+    {
+        u64toa(charAcct, acctValues[i]);
+        write(COM1, DSTR_BUF(acctLabels[i]));
+        write(COM1, DSTR_BUF(charAcct));
+    }
+    // syscall counts, in op_code order
+    const char* const opNames[MPX_PCB_ACCT_OPS] = {
+        "EXIT ", " IDLE ", " READ ", " WRITE ", " SLEEP ", " SLEEP_UNTIL "
+    };
+    write(COM1, STR_BUF("\r\nSyscalls: "));
+    for (size_t i = 0; i < MPX_PCB_ACCT_OPS; ++i)
+    {
+        u64toa(charAcct, acct.syscalls[i]);
+        write(COM1, DSTR_BUF(opNames[i]));
+        write(COM1, DSTR_BUF(charAcct));
+    }
     write(COM1, STR_BUF("\r\n"));
     return 0;
 }
 
 int deletePcbCommand() {
     setTerminalColor(Yellow);
-    const char msg[] = "Enter the name of an existing process to be deleted:\r\n";
+    const char msg[] = "Enter the name or PID of an existing process to be deleted:\r\n";
     write(COM1, STR_BUF(msg));
 
     setTerminalColor(White);
     user_input_promptread();
 
-    struct pcb* procfound = pcb_find(user_input);
+    struct pcb* procfound = pcb_find_input(user_input, user_input_len);
     user_input_clear();    
     if (procfound == NULL)
     {
@@ -697,19 +854,21 @@ int deletePcbCommand() {
         return 1;
     }
 
+    preempt_disable();
     pcb_remove(procfound);
     pcb_free(procfound);
+    preempt_enable();
     return 0;
 }
 
 int suspendPcbCommand() {
     setTerminalColor(Yellow);
-    const char msg[] = "Enter the name of an existing process to suspend:\r\n";
+    const char msg[] = "Enter the name or PID of an existing process to suspend:\r\n";
     write(COM1, STR_BUF(msg));
     setTerminalColor(White);
     user_input_promptread();
     
-    struct pcb* procfound = pcb_find(user_input);
+    struct pcb* procfound = pcb_find_input(user_input, user_input_len);
     user_input_clear();
     if (procfound == NULL)
     {
@@ -727,21 +886,23 @@ int suspendPcbCommand() {
         return 1;
     }
 
+    preempt_disable();
     pcb_remove(procfound);
     
     procfound->state.dpatch = PCB_DPATCH_SUSPENDED;
     pcb_insert(procfound);
+    preempt_enable();
     return 0;  
 }
 
 int resumePcbCommand() {
     setTerminalColor(Yellow);
-    const char msg[] = "Enter the name of an existing process to resume:\r\n";
+    const char msg[] = "Enter the name or PID of an existing process to resume:\r\n";
     write(COM1, STR_BUF(msg));
     setTerminalColor(White);
     user_input_promptread();
     
-    struct pcb* procfound = pcb_find(user_input);
+    struct pcb* procfound = pcb_find_input(user_input, user_input_len);
     user_input_clear();
     if (procfound == NULL)
     {
@@ -751,16 +912,19 @@ int resumePcbCommand() {
         return 1;
     }
     
+    preempt_disable();
     pcb_remove(procfound);
     
     procfound->state.dpatch = PCB_DPATCH_ACTIVE;
     pcb_insert(procfound);
+    preempt_enable();
     return 0;
 }
 
 int showPcbReadyCommand(){
     setTerminalColor(Yellow);
     const char msgName[] = "\r\nProcess Name: ";
+    const char msgPid[] = "\r\nProcess PID: ";
     const char msgClass[] = "\r\nProcess Class: ";
     const char msgPri[] = "\r\nProcess Priority: ";
     const char msgState[] = "\r\nProcess State: ";
@@ -769,36 +933,31 @@ int showPcbReadyCommand(){
     for (struct pcb_state i = { 0, PCB_DPATCH_SUSPENDED, PCB_EXEC_READY, 0 }; i.exec <= PCB_DPATCH_ACTIVE; ++i.exec)
     {
         struct pcb_queue* queue_curr = &pcb_queues[PSTATE_QUEUE_SELECTOR(i)];
-        // check that the queue is not empty (size > 0)
-        if (queue_curr->pcb_head != NULL)
+        for (struct pcb* proc_iter = pcb_queue_front(queue_curr); proc_iter != NULL;
+             proc_iter = pcb_queue_next(queue_curr, proc_iter))
         {
-            struct pcb* proc_iter = queue_curr->pcb_head;
-            while(1)
-            {
-                //Display information on process
-                const char* charClass = class_str(proc_iter->state.cls);
-                const char* charState = execstate_str(proc_iter->state.exec);
-                const char* charStatus = dpatchstate_str(proc_iter->state.dpatch);
-                char charPri[4];
-                itoa(charPri, (int) proc_iter->state.pri);
-
-                write(COM1, STR_BUF(msgName));
-                write(COM1, DSTR_BUF(proc_iter->name));
-                write(COM1, STR_BUF(msgClass));
-                write(COM1, DSTR_BUF(charClass));
-                write(COM1, STR_BUF(msgPri));
-                write(COM1, DSTR_BUF(charPri));
-                write(COM1, STR_BUF(msgState));
-                write(COM1, DSTR_BUF(charState));
-                write(COM1, STR_BUF(msgStatus));
-                write(COM1, DSTR_BUF(charStatus));
-                write(COM1, STR_BUF("\r\n"));
-                if (proc_iter->p_next == NULL)
-                {
-                    break;
-                }
-                proc_iter = proc_iter->p_next;
-            }
+            //Display information on process
+            const char* charClass = class_str(proc_iter->state.cls);
+            const char* charState = execstate_str(proc_iter->state.exec);
+            const char* charStatus = dpatchstate_str(proc_iter->state.dpatch);
+            char charPri[4];
+            itoa(charPri, (int) proc_iter->state.pri);
+            char charPid[12];
+            itoa(charPid, (int) proc_iter->pid);
+
+            write(COM1, STR_BUF(msgName));
+            write(COM1, DSTR_BUF(proc_iter->name));
+            write(COM1, STR_BUF(msgPid));
+            write(COM1, DSTR_BUF(charPid));
+            write(COM1, STR_BUF(msgClass));
+            write(COM1, DSTR_BUF(charClass));
+            write(COM1, STR_BUF(msgPri));
+            write(COM1, DSTR_BUF(charPri));
+            write(COM1, STR_BUF(msgState));
+            write(COM1, DSTR_BUF(charState));
+            write(COM1, STR_BUF(msgStatus));
+            write(COM1, DSTR_BUF(charStatus));
+            write(COM1, STR_BUF("\r\n"));
         }
    
     }
@@ -808,6 +967,7 @@ int showPcbReadyCommand(){
 int showPcbBlockedCommand() {
     setTerminalColor(Yellow);
     const char msgName[] = "\r\nProcess Name: ";
+    const char msgPid[] = "\r\nProcess PID: ";
     const char msgClass[] = "\r\nProcess Class: ";
     const char msgPri[] = "\r\nProcess Priority: ";
     const char msgState[] = "\r\nProcess State: ";
@@ -816,36 +976,31 @@ int showPcbBlockedCommand() {
     for (struct pcb_state i = { 0, PCB_DPATCH_SUSPENDED, PCB_EXEC_BLOCKED, 0 }; i.exec <= PCB_DPATCH_ACTIVE; ++i.exec)
     {
         struct pcb_queue* queue_curr = &pcb_queues[PSTATE_QUEUE_SELECTOR(i)];
-        // check that the queue is not empty (size > 0)
-        if (queue_curr->pcb_head != NULL)
+        for (struct pcb* proc_iter = pcb_queue_front(queue_curr); proc_iter != NULL;
+             proc_iter = pcb_queue_next(queue_curr, proc_iter))
         {
-            struct pcb* proc_iter = queue_curr->pcb_head;
-            while(1)
-            {                
-                //Display information on process
-                const char* charClass = class_str(proc_iter->state.cls);
-                const char* charState = execstate_str(proc_iter->state.exec);
-                const char* charStatus = dpatchstate_str(proc_iter->state.dpatch);
-                char charPri[4];
-                itoa(charPri, (int) proc_iter->state.pri);
-
-                write(COM1, STR_BUF(msgName));
-                write(COM1, DSTR_BUF(proc_iter->name));
-                write(COM1, STR_BUF(msgClass));
-                write(COM1, DSTR_BUF(charClass));
-                write(COM1, STR_BUF(msgPri));
-                write(COM1, DSTR_BUF(charPri));
-                write(COM1, STR_BUF(msgState));
-                write(COM1, DSTR_BUF(charState));
-                write(COM1, STR_BUF(msgStatus));
-                write(COM1, DSTR_BUF(charStatus));
-                write(COM1, STR_BUF("\r\n"));
-                if (proc_iter->p_next == NULL)
-                {
-                    break;
-                }
-                proc_iter = proc_iter->p_next;
-            }
+            //Display information on process
+            const char* charClass = class_str(proc_iter->state.cls);
+            const char* charState = execstate_str(proc_iter->state.exec);
+            const char* charStatus = dpatchstate_str(proc_iter->state.dpatch);
+            char charPri[4];
+            itoa(charPri, (int) proc_iter->state.pri);
+            char charPid[12];
+            itoa(charPid, (int) proc_iter->pid);
+
+            write(COM1, STR_BUF(msgName));
+            write(COM1, DSTR_BUF(proc_iter->name));
+            write(COM1, STR_BUF(msgPid));
+            write(COM1, DSTR_BUF(charPid));
+            write(COM1, STR_BUF(msgClass));
+            write(COM1, DSTR_BUF(charClass));
+            write(COM1, STR_BUF(msgPri));
+            write(COM1, DSTR_BUF(charPri));
+            write(COM1, STR_BUF(msgState));
+            write(COM1, DSTR_BUF(charState));
+            write(COM1, STR_BUF(msgStatus));
+            write(COM1, DSTR_BUF(charStatus));
+            write(COM1, STR_BUF("\r\n"));
         }
    
     }
@@ -855,6 +1010,7 @@ int showPcbBlockedCommand() {
 int showPcbAllCommand() {
     setTerminalColor(Yellow);
     const char msgName[] = "\r\nProcess Name: ";
+    const char msgPid[] = "\r\nProcess PID: ";
     const char msgClass[] = "\r\nProcess Class: ";
     const char msgPri[] = "\r\nProcess Priority: ";
     const char msgState[] = "\r\nProcess State: ";
@@ -863,36 +1019,31 @@ int showPcbAllCommand() {
     for (size_t i = 0; i < sizeof(pcb_queues) / sizeof(struct pcb_queue); ++i)
     {
         struct pcb_queue* queue_curr = &pcb_queues[i];
-        // check that the queue is not empty (size > 0)
-        if (queue_curr->pcb_head != NULL)
+        for (struct pcb* proc_iter = pcb_queue_front(queue_curr); proc_iter != NULL;
+             proc_iter = pcb_queue_next(queue_curr, proc_iter))
         {
-            struct pcb* proc_iter = queue_curr->pcb_head;
-            while(1)
-            {                
-                //Display information on process
-                const char* charClass = class_str(proc_iter->state.cls);
-                const char* charState = execstate_str(proc_iter->state.exec);
-                const char* charStatus = dpatchstate_str(proc_iter->state.dpatch);
-                char charPri[4];
-                itoa(charPri, (int) proc_iter->state.pri);
-
-                write(COM1, STR_BUF(msgName));
-                write(COM1, DSTR_BUF(proc_iter->name));
-                write(COM1, STR_BUF(msgClass));
-                write(COM1, DSTR_BUF(charClass));
-                write(COM1, STR_BUF(msgPri));
-                write(COM1, DSTR_BUF(charPri));
-                write(COM1, STR_BUF(msgState));
-                write(COM1, DSTR_BUF(charState));
-                write(COM1, STR_BUF(msgStatus));
-                write(COM1, DSTR_BUF(charStatus));
-                write(COM1, STR_BUF("\r\n"));
-                if (proc_iter->p_next == NULL)
-                {
-                    break;
-                }
-                proc_iter = proc_iter->p_next;
-            }
+            //Display information on process
+            const char* charClass = class_str(proc_iter->state.cls);
+            const char* charState = execstate_str(proc_iter->state.exec);
+            const char* charStatus = dpatchstate_str(proc_iter->state.dpatch);
+            char charPri[4];
+            itoa(charPri, (int) proc_iter->state.pri);
+            char charPid[12];
+            itoa(charPid, (int) proc_iter->pid);
+
+            write(COM1, STR_BUF(msgName));
+            write(COM1, DSTR_BUF(proc_iter->name));
+            write(COM1, STR_BUF(msgPid));
+            write(COM1, DSTR_BUF(charPid));
+            write(COM1, STR_BUF(msgClass));
+            write(COM1, DSTR_BUF(charClass));
+            write(COM1, STR_BUF(msgPri));
+            write(COM1, DSTR_BUF(charPri));
+            write(COM1, STR_BUF(msgState));
+            write(COM1, DSTR_BUF(charState));
+            write(COM1, STR_BUF(msgStatus));
+            write(COM1, DSTR_BUF(charStatus));
+            write(COM1, STR_BUF("\r\n"));
         }
    
     }
@@ -915,15 +1066,17 @@ int shutdownCommand() {
         user_input_clear();
         
         // clean up all processes
+        preempt_disable();
         for (unsigned int i = 0; i < sizeof(pcb_queues) / sizeof(struct pcb_queue); ++i)
         {
-            while (pcb_queues[i].pcb_head != NULL)
+            struct pcb* hdl;
+            while ((hdl = pcb_queue_front(&pcb_queues[i])) != NULL)
             {
-                struct pcb* hdl = pcb_queues[i].pcb_head;
                 pcb_remove(hdl);
                 pcb_free(hdl);
             }
         }
+        preempt_enable();
 
         sys_req(EXIT);
     }
@@ -1008,10 +1161,6 @@ int alarmCommand() {
 
     setTerminalColor(White);
     user_input_promptread();
-    // must be freed in spawned process
-    char* alarm_msg = sys_alloc_mem(user_input_len + 1);
-    memcpy(alarm_msg, user_input, user_input_len);
-
     char timername[MPX_PCB_PROCNAME_BUFFER_SZ] = ALARMCMD_TIMER_PREFIX;
     // cannot have a negative integer postfix and have to avoid overflow
     for (unsigned int i = 0; i < ALARMCMD_MAX_ALARM_ID; ++i)
@@ -1024,6 +1173,20 @@ int alarmCommand() {
         memset (timername + ALARMCMD_TIMER_PREFIX_SZ, 0, strlen(&timername[ALARMCMD_TIMER_PREFIX_SZ]));
     }
     struct pcb* timerpcb = pcb_setup(timername, PCB_CLASS_USER, 0);
+    // kept in the spawned process's arena, released when it exits
+    char* alarm_msg = (timerpcb != NULL) ? arena_alloc(&timerpcb->arena, user_input_len + 1) : NULL;
+    if (alarm_msg == NULL) {
+        if (timerpcb != NULL) {
+            pcb_free(timerpcb);
+        }
+        user_input_clear();
+        setTerminalColor(Red);
+        static const char alloc_error_msg[] = "The alarm process could not be created.\r\n";
+        write(COM1, STR_BUF(alloc_error_msg));
+        return 1;
+    }
+    memcpy(alarm_msg, user_input, user_input_len);
+    alarm_msg[user_input_len] = '\0';
     struct alarmProcessParams alarm_args = {
         hour,
         minute,
@@ -1236,12 +1399,16 @@ int freeMemoryCommand() {
 }
 
 int showAllocatedMemoryCommand() {    
-    struct mcb* currList = alloc_head;
+    struct mcb* currList = heap_block_first();
     char allocatedMemoryMsg[] = "\r\nAllocated Memory:\r\n";
     write(COM1, STR_BUF(allocatedMemoryMsg));
     
-    while(currList != NULL)
+    for (; currList != NULL; currList = heap_block_next(currList))
     {
+        if (currList -> blk_free)
+        {
+            continue;
+        }
         char addressMsg[] = "\tAddress: ";
         write(COM1, STR_BUF(addressMsg));
 
@@ -1262,19 +1429,21 @@ int showAllocatedMemoryCommand() {
         write(COM1, STR_BUF(sizeMsg));
         write(COM1, DSTR_BUF(printSize));
         write(COM1, STR_BUF(newLine));
-        
-        currList = currList -> p_next;
     }
     return 0;
 }
 
 int showFreeMemoryCommand() {
-    struct mcb* currList = free_head;
+    struct mcb* currList = heap_block_first();
     char freeMemoryMsg[] = "\r\nFreed Memory:\r\n";
     write(COM1, STR_BUF(freeMemoryMsg));
     
-    while(currList != NULL)
+    for (; currList != NULL; currList = heap_block_next(currList))
     {
+        if (!(currList -> blk_free))
+        {
+            continue;
+        }
         char addressMsg[] = "\tAddress: ";
         write(COM1, STR_BUF(addressMsg));
 
@@ -1292,12 +1461,234 @@ int showFreeMemoryCommand() {
         write(COM1, STR_BUF(sizeMsg));
         write(COM1, DSTR_BUF(printSize));
         write(COM1, STR_BUF(newLine));
-        
-        currList = currList -> p_next;
     }
     return 0;
 }
 
+int quantumCommand() {
+    char quantum_str[12];
+    itoa(quantum_str, (int) timer_get_quantum());
+
+    setTerminalColor(Yellow);
+    const char curMsg[] = "The current time slice (ms) is: ";
+    write(COM1, STR_BUF(curMsg));
+    write(COM1, DSTR_BUF(quantum_str));
+    write(COM1, STR_BUF("\r\n"));
+
+    static const char error_msg[] = "Time slice is not in the accepted range.\r\n";
+    while (1) {
+        setTerminalColor(Yellow);
+        const char msg[] = "Enter a new time slice in ms (1-1000), or nothing to keep it:\r\n";
+        write(COM1, STR_BUF(msg));
+
+        setTerminalColor(White);
+        user_input_promptread();
+        if (user_input_len == 0) {
+            user_input_clear();
+            return 0;
+        }
+        if ((user_input_len <= 4) && intParsable(user_input, user_input_len)) {
+            int quantum = atoi(user_input);
+            if (timer_set_quantum((unsigned int) quantum) == 0) {
+                user_input_clear();
+                break;
+            }
+        }
+        user_input_clear();
+
+        setTerminalColor(Red);
+        write(COM1, STR_BUF(error_msg));
+    }
+    return 0;
+}
+
+int benchmarkCommand() {
+    setTerminalColor(Yellow);
+    const char msg[] = "Running benchmarks, this may take a moment...\r\n";
+    write(COM1, STR_BUF(msg));
+
+    setTerminalColor(White);
+    if (bench_run(COM1) != 0) {
+        setTerminalColor(Red);
+        const char errMsg[] = "Some benchmarks could not be set up.\r\n";
+        write(COM1, STR_BUF(errMsg));
+        return 1;
+    }
+    return 0;
+}
+
+int showCachesCommand() {
+    setTerminalColor(Yellow);
+    const char msg[] = "\r\nObject Caches:\r\n";
+    write(COM1, STR_BUF(msg));
+    setTerminalColor(White);
+
+    for (struct slab_cache* cache = slab_cache_first(); cache != NULL; cache = cache->p_next) {
+        // snapshot so the line is consistent even if a process uses the cache meanwhile
+        preempt_disable();
+        struct slab_cache stats = *cache;
+        preempt_enable();
+
+        static const char* const labels[] = {
+            "\tSize: ", "\tSlabs: ", "\tObjects: ", "\tIn Use: ",
+            "\tAllocs: ", "\tFrees: ", "\tFails: "
+        };
+        const uint32_t values[] = {
+            (uint32_t) stats.obj_size, stats.stat_slabs, stats.stat_objs, stats.stat_in_use,
+            stats.stat_allocs, stats.stat_frees, stats.stat_fails
+        };
+        write(COM1, DSTR_BUF(stats.name));
+        for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+            char num[12];
+            itoa(num, (int) values[i]);
+            write(COM1, DSTR_BUF(labels[i]));
+            write(COM1, DSTR_BUF(num));
+        }
+        write(COM1, STR_BUF("\r\n"));
+    }
+    return 0;
+}
+
+int heapTraceCommand() {
+    setTerminalColor(White);
+    if (heap_trace_dump(COM1) != 0) {
+        setTerminalColor(Red);
+        const char errMsg[] = "Heap tracing is not built in, rebuild with HEAP_TRACE=1.\r\n";
+        write(COM1, STR_BUF(errMsg));
+        return 1;
+    }
+    return 0;
+}
+
+// appends a string, then a number, to a buffer being built for a single write
+static void statsAppend(char* buf, size_t* len, size_t sz, const char* label, uint32_t num) {
+    char num_str[21];
+    u64toa(num_str, num);
+    *len = strappend(buf, *len, sz, label);
+    *len = strappend(buf, *len, sz, num_str);
+}
+
+int heapStatsCommand() {
+    struct heap_stats stats;
+    heap_stats_get(&stats);
+
+    // 12 lines of at most 80 characters
+    static char buf[1024];
+    size_t len = 0;
+    statsAppend(buf, &len, sizeof(buf), "\r\nHeap Statistics:\r\n\tHeap Size: ", stats.bytes_heap);
+    statsAppend(buf, &len, sizeof(buf), "\r\n\tIn Use: ", stats.bytes_in_use);
+    statsAppend(buf, &len, sizeof(buf), " bytes in ", stats.used_blocks);
+    statsAppend(buf, &len, sizeof(buf), " blocks\r\n\tFree: ", stats.bytes_free);
+    statsAppend(buf, &len, sizeof(buf), " bytes in ", stats.free_blocks);
+    statsAppend(buf, &len, sizeof(buf), " blocks\r\n\tLargest Free Block: ", stats.largest_free);
+    statsAppend(buf, &len, sizeof(buf), "\r\n\tFragmentation: ", stats.frag_permille / 10);
+    statsAppend(buf, &len, sizeof(buf), ".", stats.frag_permille % 10);
+    statsAppend(buf, &len, sizeof(buf), "%\r\n\tAllocations: ", stats.allocs);
+    statsAppend(buf, &len, sizeof(buf), "\tFrees: ", stats.frees);
+    statsAppend(buf, &len, sizeof(buf), "\tFailed: ", stats.fails);
+    len = strappend(buf, len, sizeof(buf), "\r\n\tAllocation Sizes:");
+    for (unsigned int i = 0; i < MPX_HEAP_HIST_BUCKETS; ++i) {
+        // two buckets per line, the last counts everything past the bound before it
+        unsigned char last = (i == MPX_HEAP_HIST_BUCKETS - 1);
+        const char* prefix = (i % 2 == 0) ? "\r\n\t\t" : "\t\t";
+        len = strappend(buf, len, sizeof(buf), prefix);
+        statsAppend(buf, &len, sizeof(buf), last ? "over " : "up to ", (uint32_t) MPX_HEAP_HIST_MIN << (last ? i - 1 : i));
+        statsAppend(buf, &len, sizeof(buf), " B: ", stats.size_hist[i]);
+    }
+    len = strappend(buf, len, sizeof(buf), "\r\n");
+
+    setTerminalColor(White);
+    write(COM1, buf, len);
+    return 0;
+}
+
+int allocProfileCommand() {
+    static struct heap_profile_site sites[MPX_HEAP_PROFILE_SITES];
+    int count = heap_profile_get(sites, MPX_HEAP_PROFILE_SITES);
+    if (count < 0) {
+        setTerminalColor(Red);
+        const char errMsg[] = "Allocation profiling is not built in, rebuild with HEAP_PROFILE=1.\r\n";
+        write(COM1, STR_BUF(errMsg));
+        return 1;
+    }
+
+    // lines are gathered and written a buffer at a time
+    static char buf[1024];
+    const size_t line_max = 192;
+    size_t len = 0;
+    setTerminalColor(White);
+    statsAppend(buf, &len, sizeof(buf), "\r\nAllocation Sites: ", (uint32_t) count);
+    for (int i = 0; i < count; ++i) {
+        if (len + line_max > sizeof(buf)) {
+            write(COM1, buf, len);
+            len = 0;
+        }
+        char site[11];
+        if (sites[i].site != NULL) {
+            addressToHex(site, sites[i].site);
+        } else {
+            memcpy(site, "other", 6);
+        }
+        len = strappend(buf, len, sizeof(buf), "\r\n\t");
+        len = strappend(buf, len, sizeof(buf), site);
+        // the owner is named while it still exists
+        struct pcb* owner = (sites[i].pid != 0) ? pcb_find_pid(sites[i].pid) : NULL;
+        const char* owner_name = (owner != NULL) ? owner->name : "-";
+        statsAppend(buf, &len, sizeof(buf), "\tPID: ", sites[i].pid);
+        len = strappend(buf, len, sizeof(buf), " (");
+        len = strappend(buf, len, sizeof(buf), owner_name);
+        statsAppend(buf, &len, sizeof(buf), ")\tLive Bytes: ", (uint32_t) sites[i].live_bytes);
+        statsAppend(buf, &len, sizeof(buf), "\tBlocks: ", sites[i].live_count);
+        statsAppend(buf, &len, sizeof(buf), "\tAllocs: ", sites[i].allocs);
+    }
+    len = strappend(buf, len, sizeof(buf), "\r\n");
+    write(COM1, buf, len);
+    return 0;
+}
+
+int serialStatsCommand() {
+    // two lines of at most 100 characters per port
+    static char buf[1024];
+    size_t len = 0;
+    len = strappend(buf, len, sizeof(buf), "\r\nSerial Ports:");
+    for (size_t i = 0; i < sizeof(serial_dcb_list) / sizeof(struct dcb); ++i) {
+        const struct dcb* dcb = &serial_dcb_list[i];
+        if (!dcb->open) {
+            continue;
+        }
+        uint32_t irqs = dcb->tx_irqs;
+        uint32_t bytes = dcb->tx_bytes;
+        // bytes per interrupt in tenths, without 64-bit division
+        uint32_t tenths = 0;
+        if (irqs != 0) {
+            tenths = (bytes / irqs) * 10 + ((bytes % irqs) * 10) / irqs;
+        }
+        statsAppend(buf, &len, sizeof(buf), "\r\n\tCOM", (uint32_t) i + 1);
+        statsAppend(buf, &len, sizeof(buf), "  TX FIFO: ", (uint32_t) dcb->tx_fifo_sz);
+        statsAppend(buf, &len, sizeof(buf), "  TX Interrupts: ", irqs);
+        statsAppend(buf, &len, sizeof(buf), "  TX Bytes: ", bytes);
+        statsAppend(buf, &len, sizeof(buf), "  Bytes/Interrupt: ", tenths / 10);
+        statsAppend(buf, &len, sizeof(buf), ".", tenths % 10);
+
+        irqs = dcb->rx_irqs;
+        bytes = dcb->rx_bytes;
+        tenths = 0;
+        if (irqs != 0) {
+            tenths = (bytes / irqs) * 10 + ((bytes % irqs) * 10) / irqs;
+        }
+        statsAppend(buf, &len, sizeof(buf), "\r\n\t      RX Trigger: ", (uint32_t) dcb->rx_trigger);
+        statsAppend(buf, &len, sizeof(buf), "  RX Interrupts: ", irqs);
+        statsAppend(buf, &len, sizeof(buf), "  RX Bytes: ", bytes);
+        statsAppend(buf, &len, sizeof(buf), "  Bytes/Interrupt: ", tenths / 10);
+        statsAppend(buf, &len, sizeof(buf), ".", tenths % 10);
+        statsAppend(buf, &len, sizeof(buf), "  Overruns: ", dcb->rx_overruns);
+    }
+    len = strappend(buf, len, sizeof(buf), "\r\n");
+    setTerminalColor(White);
+    write(COM1, buf, len);
+    return 0;
+}
+
 void comhand() {
     static const char menu_welcome_msg[] = "Welcome to 5x5 MPX.\r\n";
     static const char menu_options[] = "Please select an option by choosing a number from an entry below.\r\n"
@@ -1306,7 +1697,8 @@ void comhand() {
                                        "9 ) Show Blocked PCBs  10) Show All PCBs     11) Delete PCB   12) Suspend PCB\r\n"
                                        "13) Resume PCB         14) Version           15) Shut Down    16) loadR3\r\n"
                                        "17) Alarm              18) Allocate Memory   19) Free Memory  20) Show Free Mem\r\n"
-                                       "21) Show Alloc\'ed Mem\r\n";
+                                       "21) Show Alloc\'ed Mem  22) Quantum           23) Benchmark    24) Show Caches\r\n"
+                                       "25) Heap Trace         26) Heap Stats        27) Alloc Profile  28) Serial Stats\r\n";
     
     setTerminalColor(Blue);
     write(COM1, STR_BUF(menu_welcome_msg));
@@ -113,10 +113,12 @@ simple_isr(invalid_tss, "Invalid TSS")
 simple_isr(segment_not_present, "Segment not present")
 simple_isr(stack_segment, "Stack segment error")
 simple_isr(general_protection, "General protection fault")
-simple_isr(page_fault, "Page Fault")
 simple_isr(reserved, "Reserved")
 simple_isr(coprocessor, "Coprocessor error")
 
+// page faults are resolved by the virtual memory manager below
+static __attribute__((interrupt)) void page_fault(void *int_frame, unsigned long error_code);
+
 static void idt_set_gate(size_t idx, isr_function fn, uint16_t sel, uint8_t flags)
 {
 	uintptr_t base = (uintptr_t)fn;
@@ -161,7 +163,7 @@ void irq_init(void)
 		segment_not_present,
 		stack_segment,
 		general_protection,
-		page_fault,
+		(isr_function)(void (*)(void))page_fault,
 		reserved,
 		coprocessor,
 	};
@@ -227,6 +229,7 @@ noreturn void kpanic(const char *msg)
  * ************************************************************************/
 #include <mpx/panic.h>
 #include <mpx/vm.h>
+#include <mpx/multiboot.h>
 #include <limits.h>
 #include <string.h>
 #include <stdint.h>
@@ -241,15 +244,30 @@ noreturn void kpanic(const char *msg)
 // 4 KB pages
 #define PAGE_SIZE	0x1000
 
-// 64 MB total memory
-// TODO: learn this from boot parameters
-#define MEM_SIZE	0x4000000
+// 4 MB, the memory covered by one page table or one large page
+#define PAGE_TABLE_SPAN	0x400000
+
+// page directory entry flag mapping a 4 MB page instead of a page table
+#define PDE_LARGE	0x80
+
+// most demand paged regions that can be registered
+#define VM_REGIONS_MAX	8
+
+// page fault error code bit set if the page was present, i.e. a protection fault
+#define PF_PRESENT	0x1
 
-// number of frames
-#define NFRAMES		(MEM_SIZE / PAGE_SIZE)
+// CPUID leaf 1 EDX bit for page size extension, and the CR4 bit enabling it
+#define CPUID_EDX_PSE	(1 << 3)
+#define CR4_PSE	(1 << 4)
 
-// bits per frame
-#define FRAME_BIT	(sizeof(uint32_t) * CHAR_BIT)
+// 64 MB total memory, assumed when the bootloader provides no memory information
+#define MEM_SIZE_DEFAULT	0x4000000
+
+// most available ranges kept from the bootloader's memory map
+#define MEM_RANGES_MAX	32
+
+// terminates the buddy free lists
+#define FRAME_NONE	((uint32_t) -1)
 
 /*
   Page entry structure
@@ -282,12 +300,47 @@ typedef struct {
 	uint32_t tables_phys[1024];
 } page_dir;
 
-// bitmap of frames
-static uint32_t frames[NFRAMES / FRAME_BIT] = { 0 };
+/*
+  Buddy allocator bookkeeping for a frame
+  Only meaningful for the first frame of a free block
+*/
+struct frame_info {
+	uint32_t next;	// next free block of the same order, FRAME_NONE at the end
+	uint32_t prev;	// previous free block of the same order, FRAME_NONE at the head
+	uint8_t order;	// the block spans 2^order frames
+	uint8_t free;	// non-zero if the frame heads a free block
+};
+
+// per frame bookkeeping, placed in physical memory by vm_init
+static struct frame_info *frame_meta;
+
+// heads of the free lists of each order, and a bit per non-empty list
+static uint32_t frame_free_lists[FRAME_ORDER_MAX + 1];
+static uint32_t frame_free_orders = 0;
+
+// number of free frames
+static uint32_t frame_free_total = 0;
+
+// number of frames up to the end of the highest available memory
+static uint32_t nframes = MEM_SIZE_DEFAULT / PAGE_SIZE;
+
+// available memory ranges as [first, end) frame numbers, anything else is reserved
+static struct {
+	uint32_t first;
+	uint32_t end;
+} mem_ranges[MEM_RANGES_MAX] = { { 0, MEM_SIZE_DEFAULT / PAGE_SIZE } };
+static unsigned int mem_range_count = 1;
 
 // kernel page directory
 static page_dir *kdir;
 
+// ranges whose pages are mapped on first touch, as [start, end) addresses
+static struct {
+	uint32_t start;
+	uint32_t end;
+} vm_regions[VM_REGIONS_MAX];
+static unsigned int vm_region_count = 0;
+
 // physical end of kernel image
 // defined by linker
 extern void *__end;
@@ -366,30 +419,183 @@ void *kmalloc(uint32_t size, int page_align, void **phys_addr)
 	return addr;
 }
 
-/* Finds the first free page frame */
-static uint32_t find_free()
+/* Links a block into the free list of its order */
+static void frame_list_insert(uint32_t frame, unsigned int order)
+{
+	frame_meta[frame].order = order;
+	frame_meta[frame].free = 1;
+	frame_meta[frame].prev = FRAME_NONE;
+	frame_meta[frame].next = frame_free_lists[order];
+	if (frame_free_lists[order] != FRAME_NONE) {
+		frame_meta[frame_free_lists[order]].prev = frame;
+	}
+	frame_free_lists[order] = frame;
+	frame_free_orders |= 1 << order;
+}
+
+/* Unlinks a block from the free list of its order */
+static void frame_list_remove(uint32_t frame)
 {
-	uint32_t i, j;
-	for (i = 0; i < NFRAMES / FRAME_BIT; i++)
-		if (frames[i] != 0xFFFFFFFF)	//if frame not full
-			for (j = 0; j < FRAME_BIT; j++)	//find first free bit
-				if (!(frames[i] & (1 << j)))
-					return i * FRAME_BIT + j;
-
-	return -1;		//no free frames
+	struct frame_info *info = &frame_meta[frame];
+	if (info->prev != FRAME_NONE) {
+		frame_meta[info->prev].next = info->next;
+	} else {
+		frame_free_lists[info->order] = info->next;
+	}
+	if (info->next != FRAME_NONE) {
+		frame_meta[info->next].prev = info->prev;
+	}
+	if (frame_free_lists[info->order] == FRAME_NONE) {
+		frame_free_orders &= ~(1 << info->order);
+	}
+	info->free = 0;
 }
 
-/* Marks a page frame bit as in use */
-static void set_bit(uint32_t addr)
+/*
+ Hands the frames in [first, end) to the buddy allocator as the largest
+ naturally aligned blocks that fit.
+*/
+static void frame_add_range(uint32_t first, uint32_t end)
 {
-	uint32_t frame = addr / PAGE_SIZE;
-	uint32_t index = frame / FRAME_BIT;
-	uint32_t offset = frame % FRAME_BIT;
-	frames[index] |= (1 << offset);
+	while (first < end) {
+		unsigned int order = FRAME_ORDER_MAX;
+		while (order > 0 &&
+		       ((first & ((1 << order) - 1)) || first + (1 << order) > end)) {
+			order--;
+		}
+		frame_list_insert(first, order);
+		frame_free_total += 1 << order;
+		first += 1 << order;
+	}
+}
+
+/* Frees every available frame from the given one on */
+static void frame_init(uint32_t first)
+{
+	for (unsigned int order = 0; order <= FRAME_ORDER_MAX; order++) {
+		frame_free_lists[order] = FRAME_NONE;
+	}
+	memset(frame_meta, 0, nframes * sizeof(*frame_meta));
+
+	for (unsigned int i = 0; i < mem_range_count; i++) {
+		uint32_t range_first = mem_ranges[i].first;
+		if (range_first < first) {
+			range_first = first;
+		}
+		frame_add_range(range_first, mem_ranges[i].end);
+	}
 }
 
 /*
- Marks a frame as in use in the frame bitmap, sets up the page,
+ Records the available memory reported by a multiboot bootloader, keeping
+ the 64 MB default if it reported none. Must run before anything is placed
+ after the kernel image, as the boot information may be located there.
+*/
+static void mem_detect(const struct multiboot_info *mbi)
+{
+	if (mbi == NULL) {
+		return;
+	}
+
+	if (mbi->flags & MULTIBOOT_INFO_MEM_MAP) {
+		unsigned int count = 0;
+		uint32_t top = 0;
+		uintptr_t entry_addr = mbi->mmap_addr;
+		while (entry_addr < mbi->mmap_addr + mbi->mmap_length && count < MEM_RANGES_MAX) {
+			const struct multiboot_mmap_entry *entry = (const void *)entry_addr;
+			entry_addr += entry->size + sizeof(entry->size);
+			// only whole frames of available memory below 4 GB are usable
+			// note: shifts keep the 64-bit math free of libgcc division helpers
+			uint64_t begin = (entry->addr + PAGE_SIZE - 1) >> 12;
+			uint64_t end = (entry->addr + entry->len) >> 12;
+			if (entry->type != MULTIBOOT_MEMORY_AVAILABLE || begin >= 0x100000) {
+				continue;
+			}
+			if (end > 0x100000) {
+				end = 0x100000;
+			}
+			if (begin >= end) {
+				continue;
+			}
+			mem_ranges[count].first = begin;
+			mem_ranges[count].end = end;
+			count++;
+			if (end > top) {
+				top = end;
+			}
+		}
+		if (count > 0) {
+			mem_range_count = count;
+			nframes = top;
+			return;
+		}
+	}
+
+	if (mbi->flags & MULTIBOOT_INFO_MEMORY) {
+		// mem_upper counts KiB contiguous from 1 MB
+		nframes = (0x100000 + mbi->mem_upper * 1024) / PAGE_SIZE;
+		mem_ranges[0].first = 0;
+		mem_ranges[0].end = nframes;
+		mem_range_count = 1;
+	}
+}
+
+size_t frame_total_count(void)
+{
+	return nframes;
+}
+
+uintptr_t frame_alloc(unsigned int order)
+{
+	if (order > FRAME_ORDER_MAX) {
+		return 0;
+	}
+
+	// smallest non-empty order that can satisfy the request
+	uint32_t orders = frame_free_orders & ~((1 << order) - 1);
+	if (orders == 0) {
+		return 0;
+	}
+	unsigned int found = __builtin_ctz(orders);
+	uint32_t frame = frame_free_lists[found];
+	frame_list_remove(frame);
+
+	// split, returning the upper halves to the free lists
+	while (found > order) {
+		found--;
+		frame_list_insert(frame + (1 << found), found);
+	}
+	frame_meta[frame].order = order;
+	frame_free_total -= 1 << order;
+	return (uintptr_t) frame * PAGE_SIZE;
+}
+
+void frame_free(uintptr_t phys, unsigned int order)
+{
+	uint32_t frame = phys / PAGE_SIZE;
+	frame_free_total += 1 << order;
+
+	// merge with the buddy for as long as it is a free block of the same order
+	while (order < FRAME_ORDER_MAX) {
+		uint32_t buddy = frame ^ (1 << order);
+		if (buddy >= nframes || !frame_meta[buddy].free ||
+		    frame_meta[buddy].order != order) {
+			break;
+		}
+		frame_list_remove(buddy);
+		frame &= ~(1 << order);
+		order++;
+	}
+	frame_list_insert(frame, order);
+}
+
+size_t frame_free_count(void)
+{
+	return frame_free_total;
+}
+
+/*
+ Takes a frame from the frame allocator, sets up the page,
  and saves the frame index in the page.
 */
 static void new_frame(page_entry * page)
@@ -398,41 +604,215 @@ static void new_frame(page_entry * page)
 		return;
 	}
 
-	uint32_t index = find_free();
-	if (index == (uint32_t) (-1)) {
+	uintptr_t phys = frame_alloc(0);
+	if (phys == 0) {
 		kpanic("Out of memory");
 	}
 
-	//mark a frame as in-use
-	set_bit(index * PAGE_SIZE);
+	uint32_t index = phys / PAGE_SIZE;
 	page->present = 1;
 	page->frameaddr = index;
 	page->writeable = 1;
 	page->usermode = 0;
 }
 
-void vm_init(void)
+void vm_unmap(void *vaddr, size_t pages)
+{
+	for (size_t i = 0; i < pages; i++) {
+		uint32_t addr = (uint32_t) vaddr + i * PAGE_SIZE;
+		page_entry *page = get_page(addr, kdir, 0);
+		if (page == NULL || !page->present) {
+			continue;
+		}
+		frame_free(page->frameaddr * PAGE_SIZE, 0);
+		memset(page, 0, sizeof(*page));
+		__asm__ volatile ("invlpg (%0)" :: "r"(addr) : "memory");
+	}
+}
+
+int vm_map(void *vaddr, size_t pages)
+{
+	for (size_t i = 0; i < pages; i++) {
+		uint32_t addr = (uint32_t) vaddr + i * PAGE_SIZE;
+		// only ranges whose page tables already exist can be mapped
+		page_entry *page = get_page(addr, kdir, 0);
+		if (page == NULL || page->present) {
+			vm_unmap(vaddr, i);
+			return -1;
+		}
+		uintptr_t phys = frame_alloc(0);
+		if (phys == 0) {
+			vm_unmap(vaddr, i);
+			return -1;
+		}
+		page->present = 1;
+		page->frameaddr = phys / PAGE_SIZE;
+		page->writeable = 1;
+		page->usermode = 0;
+	}
+	return 0;
+}
+
+int vm_region_add(void *base, size_t size)
+{
+	uint32_t start = (uint32_t) base;
+	if ((start & (PAGE_SIZE - 1)) || (size & (PAGE_SIZE - 1)) || size == 0
+	    || vm_region_count == VM_REGIONS_MAX) {
+		return -1;
+	}
+	// faults are only resolved where page tables already exist
+	for (uint32_t addr = start; addr - start < size; addr += PAGE_TABLE_SPAN) {
+		if (get_page(addr, kdir, 0) == NULL) {
+			return -1;
+		}
+	}
+	if (get_page(start + size - PAGE_SIZE, kdir, 0) == NULL) {
+		return -1;
+	}
+	vm_regions[vm_region_count].start = start;
+	vm_regions[vm_region_count].end = start + size;
+	vm_region_count++;
+	return 0;
+}
+
+int vm_region_remove(void *base)
 {
+	for (unsigned int i = 0; i < vm_region_count; i++) {
+		if (vm_regions[i].start == (uint32_t) base) {
+			vm_unmap(base, (vm_regions[i].end - vm_regions[i].start) / PAGE_SIZE);
+			vm_regions[i] = vm_regions[--vm_region_count];
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/*
+ Maps a zero-filled frame at a page of a demand paged region.
+ Returns 0 if the page was mapped.
+*/
+static int vm_demand_map(uint32_t addr)
+{
+	for (unsigned int i = 0; i < vm_region_count; i++) {
+		if (addr < vm_regions[i].start || addr >= vm_regions[i].end) {
+			continue;
+		}
+		page_entry *page = get_page(addr, kdir, 0);
+		if (page == NULL || page->present) {
+			return -1;
+		}
+		uintptr_t phys = frame_alloc(0);
+		if (phys == 0) {
+			return -1;
+		}
+		page->present = 1;
+		page->frameaddr = phys / PAGE_SIZE;
+		page->writeable = 1;
+		page->usermode = 0;
+		memset((void *)(addr & ~(PAGE_SIZE - 1)), 0, PAGE_SIZE);
+		return 0;
+	}
+	return -1;
+}
+
+static __attribute__((interrupt)) void page_fault(void *int_frame, unsigned long error_code)
+{
+	(void)int_frame;
+	uint32_t addr;
+	__asm__ volatile ("mov %%cr2,%0" : "=r"(addr));
+
+	// only faults on pages not present yet can be resolved
+	if (!(error_code & PF_PRESENT) && vm_demand_map(addr) == 0) {
+		return;
+	}
+
+	char msg[] = "Page fault at 0x00000000";
+	static const char digits[] = "0123456789ABCDEF";
+	for (int i = 0; i < 8; i++) {
+		msg[sizeof(msg) - 2 - i] = digits[(addr >> (i * 4)) & 0xF];
+	}
+	kpanic(msg);
+}
+
+/*
+ Enables 4 MB pages if the processor supports them.
+ Returns non-zero if they were enabled.
+*/
+static int vm_pse_enable(void)
+{
+	uint32_t eax = 1, ebx, ecx, edx;
+	__asm__ volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+	if (!(edx & CPUID_EDX_PSE)) {
+		return 0;
+	}
+	uint32_t cr4;
+	__asm__ volatile ("mov %%cr4,%0" : "=r"(cr4));
+	cr4 |= CR4_PSE;
+	__asm__ volatile ("mov %0,%%cr4" :: "r"(cr4));
+	return 1;
+}
+
+void vm_init(const struct multiboot_info *mbi)
+{
+	mem_detect(mbi);
+
 	// create kernel directory
 	kdir = kmalloc(sizeof(*kdir), 1, 0);	//page aligned
 	memset(kdir, 0, sizeof(*kdir));
 
-	// get pages for kernel heap
-	for (uint32_t i = KHEAP_BASE; i < (KHEAP_BASE + KHEAP_SIZE); i += 1) {
+	// place the frame allocator's bookkeeping so it is identity mapped below
+	frame_meta = kmalloc(nframes * sizeof(*frame_meta), 0, 0);
+
+	// create the page tables of the kernel heap and of the range reserved for
+	// the growable heap now, while they can still be placed page aligned in
+	// physical memory
+	for (uint32_t i = KHEAP_BASE; i < (KHEAP_BASE + KHEAP_SIZE); i += PAGE_TABLE_SPAN) {
+		get_page(i, kdir, 1);
+	}
+	for (uint32_t i = VM_HEAP_BASE; i < (VM_HEAP_BASE + VM_HEAP_MAX); i += PAGE_TABLE_SPAN) {
 		get_page(i, kdir, 1);
 	}
 
-	// perform identity mapping of used memory
-	// note: placement_addr gets incremented in get_page,
-	// so we're mapping the first frames as well
-	for (uint32_t i = 0; i < (phys_alloc_addr + 0x10000); i += PAGE_SIZE) {
-		new_frame(get_page(i, kdir, 1));
+	// perform identity mapping of used memory, one directory entry at a time.
+	// the first entry always gets a page table so the 0 page (NULL) can fault,
+	// as does the last, partly used one, so frames past the used memory are
+	// not mapped. the rest are 4 MB pages if the processor has them. tables
+	// placed here move the end of used memory, so it is checked again on every
+	// entry; an entry found wholly used stays so
+	int pse = vm_pse_enable();
+	for (uint32_t i = 0; i * PAGE_TABLE_SPAN < (phys_alloc_addr + 0x10000); i++) {
+		if (i == 0 || !pse || (i + 1) * PAGE_TABLE_SPAN > (phys_alloc_addr + 0x10000)) {
+			get_page(i * PAGE_TABLE_SPAN, kdir, 1);
+		} else {
+			kdir->tables[i] = NULL;
+			kdir->tables_phys[i] = (i * PAGE_TABLE_SPAN) | PDE_LARGE | 0x3;
+		}
 	}
+	uint32_t identity_end = (phys_alloc_addr + 0x10000 + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	for (uint32_t i = 0; i * PAGE_TABLE_SPAN < identity_end; i++) {
+		page_table *table = kdir->tables[i];
+		if (table == NULL) {
+			continue;
+		}
+		// fill the whole table in one pass, entries past the used memory stay empty
+		uint32_t *entries = (uint32_t *) table->pages;
+		uint32_t frame = i * 1024;
+		uint32_t count = identity_end / PAGE_SIZE - frame;
+		if (count > 1024) {
+			count = 1024;
+		}
+		for (uint32_t j = 0; j < count; j++) {
+			entries[j] = ((frame + j) * PAGE_SIZE) | 0x3;
+		}
+	}
+
+	// every available frame past the identity mapped ones is free
+	frame_init(identity_end / PAGE_SIZE);
 
-	// allocate heap frames now that the placement addr has increased.
-	// placement addr increases here for heap
-	for (uint32_t i = KHEAP_BASE; i < (KHEAP_BASE + KHEAP_SIZE); i += PAGE_SIZE) {
-		new_frame(get_page(i, kdir, 1));
+	// allocate heap frames now that the placement addr has increased
+	page_table *kheap_table = kdir->tables[KHEAP_BASE / PAGE_TABLE_SPAN];
+	for (uint32_t i = 0; i < KHEAP_SIZE / PAGE_SIZE; i++) {
+		new_frame(&kheap_table->pages[(KHEAP_BASE / PAGE_SIZE) % 1024 + i]);
 	}
 
 	// enable page faults on the 0 page (NULL)
@@ -0,0 +1,117 @@
+#include <mpx/fpu.h>
+
+#include <stdint.h>
+#include <mpx/pcb.h>
+#include <mpx/panic.h>
+#include <mpx/interrupts.h>
+
+
+#define CR0_MP (1 << 1) // monitor coprocessor, wait/fwait honors TS
+#define CR0_EM (1 << 2) // emulation, FPU instructions always trap
+#define CR0_TS (1 << 3) // task switched, next FPU instruction raises #NM
+#define CR0_NE (1 << 5) // native FPU error reporting
+#define CR4_OSFXSR     (1 << 9)
+#define CR4_OSXMMEXCPT (1 << 10)
+
+#define CPUID_EDX_FXSR (1 << 24)
+#define CPUID_EDX_SSE  (1 << 25)
+
+#define FPU_NM_VECTOR (7)
+#define MXCSR_DEFAULT (0x1F80)
+
+// FXSAVE requires a 16 byte aligned area
+#define PCB_FPU_AREA(pcb) ((void*)(((uintptr_t)(pcb)->fpu_area + 15) & ~(uintptr_t)15))
+
+// process whose state is currently loaded in the FPU registers, if any
+static struct pcb* fpu_owner = NULL;
+static unsigned char fpu_has_sse = 0;
+
+static inline void fpu_set_ts(void)
+{
+    uint32_t cr0;
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr0));
+    __asm__ volatile ("mov %0, %%cr0" :: "r"(cr0 | CR0_TS));
+}
+
+static __attribute__((interrupt)) void fpu_isr(void* int_frame)
+{
+    (void)int_frame;
+    __asm__ volatile ("clts");
+    if (fpu_owner == pcb_running)
+    {
+        return;
+    }
+    if (pcb_running == NULL)
+    {
+        kpanic("FPU used outside of a process");
+    }
+    // save the previous owner's state and load the running process' state
+    if (fpu_owner != NULL)
+    {
+        __asm__ volatile ("fxsave (%0)" :: "r"(PCB_FPU_AREA(fpu_owner)) : "memory");
+    }
+    if (pcb_running->fpu_used)
+    {
+        __asm__ volatile ("fxrstor (%0)" :: "r"(PCB_FPU_AREA(pcb_running)) : "memory");
+    }
+    else // first use, start from a clean state
+    {
+        __asm__ volatile ("fninit");
+        if (fpu_has_sse)
+        {
+            uint32_t mxcsr = MXCSR_DEFAULT;
+            __asm__ volatile ("ldmxcsr %0" :: "m"(mxcsr));
+        }
+        pcb_running->fpu_used = 1;
+    }
+    fpu_owner = pcb_running;
+}
+
+int fpu_init(void)
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+    __asm__ volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    if (!(edx & CPUID_EDX_FXSR))
+    {
+        return -1;
+    }
+    fpu_has_sse = (edx & CPUID_EDX_SSE) != 0;
+
+    uint32_t cr0;
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr0));
+    cr0 &= ~CR0_EM;
+    cr0 |= CR0_MP | CR0_NE | CR0_TS;
+    __asm__ volatile ("mov %0, %%cr0" :: "r"(cr0));
+
+    uint32_t cr4;
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR;
+    if (fpu_has_sse)
+    {
+        cr4 |= CR4_OSXMMEXCPT;
+    }
+    __asm__ volatile ("mov %0, %%cr4" :: "r"(cr4));
+
+    idt_install(FPU_NM_VECTOR, fpu_isr);
+    return 0;
+}
+
+void fpu_switch(void)
+{
+    if ((pcb_running != NULL) && (pcb_running == fpu_owner))
+    {
+        __asm__ volatile ("clts");
+    }
+    else
+    {
+        fpu_set_ts();
+    }
+}
+
+void fpu_release(struct pcb* pcb)
+{
+    if (fpu_owner == pcb)
+    {
+        fpu_owner = NULL;
+    }
+}
@@ -1,5 +1,5 @@
 bits 32
-global rtc_isr, sys_call_isr, serial_isr
+global rtc_isr, sys_call_isr, serial_isr, timer_isr, sysenter_entry
 
 ; RTC interrupt handler
 ; Tells the slave PIC to ignore interrupts from the RTC
@@ -20,8 +20,10 @@ rtc_isr:
 
 ;;; System call interrupt handler. To be implemented in Module R3.
 extern sys_call			; The C function that sys_call_isr will call
+extern fpu_switch		; Arms lazy FPU switching after a context switch
 sys_call_isr:
     cli
+sys_call_isr_save:
     pushad
     push ss
     push ds
@@ -33,6 +35,7 @@ sys_call_isr:
     cmp eax, 0
     je sys_call_isr_nocswitch   ; R or W, then just pop, else set the stack pointer
     mov esp, eax
+    call fpu_switch             ; trap the next FPU use unless the new process owns the FPU
     jmp sys_call_isr_ret
 sys_call_isr_nocswitch:
     add esp, 4
@@ -45,6 +48,48 @@ sys_call_isr_ret:
     popad
     iret
 
+;;; SYSENTER fast system call entry. The caller has pushed its flags and passes its
+;;; stack pointer in ecx, its resume address in edx, and the buffer and length in esi
+;;; and edi. SYSENTER already cleared IF, so the int 0x60 frame is rebuilt on the
+;;; caller's stack and the rest of the call, including any context switch and the
+;;; final iret, is shared with sys_call_isr.
+sysenter_entry:
+    mov esp, ecx
+    push cs
+    push edx
+    mov ecx, esi                ; sys_call expects the buffer in ecx
+    mov edx, edi                ; and the length in edx
+    jmp sys_call_isr_save
+
+;;; PIT (IRQ0) interrupt handler. Saves a context the same way as sys_call_isr
+;;; so the running process can be preempted when its time slice expires.
+extern timer_interrupt		; The C function that timer_isr will call
+timer_isr:
+    cli
+    pushad
+    push ss
+    push ds
+    push es
+    push fs
+    push gs
+    push esp
+	call timer_interrupt
+    cmp eax, 0
+    je timer_isr_nocswitch      ; keep running the interrupted process
+    mov esp, eax
+    call fpu_switch
+    jmp timer_isr_ret
+timer_isr_nocswitch:
+    add esp, 4
+timer_isr_ret:
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    pop ss
+    popad
+    iret
+
 ;;; Serial port ISR. To be implemented in Module R6
 extern serial_interrupt
 serial_isr:
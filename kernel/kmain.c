@@ -20,6 +20,13 @@
 #include <memory.h>
 #include <mpx/pcb.h>
 #include <mpx/processes.h>
+#include <mpx/timer.h>
+#include <mpx/fpu.h>
+#include <mpx/sys_call.h>
+#include <mpx/bench.h>
+#include <mpx/multiboot.h>
+#include <mpx/tsc.h>
+#include <mpx/panic.h>
 
 #include <mpx/comhand.h>
 
@@ -32,7 +39,18 @@ static void klogv(device dev, const char *msg)
 	serial_out(dev, "\r\n", 2);
 }
 
-void kmain(void)
+static void klogv_num(device dev, const char *msg, unsigned int num)
+{
+	char prefix[] = "klogv: ";
+	char num_str[12];
+	itoa(num_str, (int) num);
+	serial_out(dev, prefix, sizeof(prefix));
+	serial_out(dev, msg, strlen(msg));
+	serial_out(dev, num_str, strlen(num_str));
+	serial_out(dev, "\r\n", 2);
+}
+
+void kmain(uint32_t mb_magic, const struct multiboot_info *mbi)
 {
     serial_init(COM1);
 	klogv(COM1, "Initialized serial I/O on COM1 device...");
@@ -75,7 +93,11 @@ void kmain(void)
 	// will also enable the kernel's (basic) heap manager, allowing the use of sys_alloc_mem()
 	// (which has a maximum of 64kiB until you implement a full memory manager).
 	klogv(COM1, "Initializing virtual memory...");
-    vm_init();
+    uint64_t vm_init_start = rdtsc();
+    vm_init((mb_magic == MULTIBOOT_BOOTLOADER_MAGIC) ? mbi : NULL);
+    klogv_num(COM1, "Virtual memory set up, cycles: ", (unsigned int) (rdtsc() - vm_init_start));
+    klogv_num(COM1, "Physical memory (KiB): ", frame_total_count() * 4);
+    klogv_num(COM1, "Free physical memory (KiB): ", frame_free_count() * 4);
 
 	// 8) MPX Modules -- *headers vary*
 	// Module specific initialization -- not all modules require this
@@ -84,8 +106,46 @@ void kmain(void)
 
 	klogv(COM1, "Initializing MPX modules...");
     initialize_heap(50000);
-	sys_set_heap_functions(allocate_memory, free_memory);
-
+	sys_set_heap_functions(pcb_alloc_mem, pcb_free_mem);
+    if (pcb_pool_init(MPX_PCB_POOL_SZ) != 0)
+    {
+        kpanic("Could not reserve the PCB pool");
+    }
+    klogv_num(COM1, "Reserved PCBs: ", MPX_PCB_POOL_SZ);
+
+    timer_init();
+    klogv(COM1, "Started PIT for preemptive time slicing...");
+
+    if (fpu_init() == 0)
+    {
+        klogv(COM1, "Enabled lazy FPU/SSE context switching...");
+    }
+    else
+    {
+        klogv(COM1, "No FXSAVE support, FPU left disabled...");
+    }
+
+    klogv_num(COM1, "Null system call via int 0x60, cycles: ", sys_call_null_cycles(0, 1000));
+    if (sys_call_fast_init() == 0)
+    {
+        klogv(COM1, "Enabled SYSENTER fast system call entry...");
+        klogv_num(COM1, "Null system call via SYSENTER, cycles: ", sys_call_null_cycles(1, 1000));
+    }
+    else
+    {
+        klogv(COM1, "No SYSENTER support, system calls use int 0x60...");
+    }
+
+#if MPX_BENCH_AT_BOOT
+	// Headless benchmark run: the suite runs as the only process and the system
+	// shuts down once it exits.
+	struct pcb* benchpcb = pcb_setup("bench", PCB_CLASS_SYSTEM, 0);
+	pcb_context_init(benchpcb, bench_process, NULL, 0);
+	pcb_insert(benchpcb);
+
+	klogv(COM1, "Transferring control to the benchmark suite...");
+	__asm__ volatile ("int $0x60" :: "a"(IDLE));
+#else
 	// 9) YOUR command handler -- *create and #include an appropriate .h file*
 	// Pass execution to your command handler so the user can interact with the system.
 	struct pcb* comhandpcb = pcb_setup("comhand", PCB_CLASS_SYSTEM, 0);
@@ -98,6 +158,7 @@ void kmain(void)
 
 	klogv(COM1, "Transferring control to comhand...");
 	__asm__ volatile ("int $0x60" :: "a"(IDLE));
+#endif
 
 	// 10) System Shutdown -- *headers to be determined by your design*
 	// After your command handler returns, take care of any clean up that is necessary.
@@ -6,308 +6,695 @@
 #include <string.h>
 #include <stdlib.h>
 #include <mpx/syscalls.h>
+#include <mpx/timer.h>
+#include <mpx/tsc.h>
+#include <mpx/pcb.h>
 
 
+// Two-level segregated fit (TLSF). Free blocks are kept in lists indexed by a
+// first level, the power of two range of their size, and a second level, one of
+// HEAP_SL_COUNT linear subdivisions of that range. A bitmap per level records
+// which lists are non-empty, so a fitting list is found with bit scans.
+#define HEAP_ALIGN_LOG2 (2)
+#define HEAP_ALIGN      (1 << HEAP_ALIGN_LOG2)
+#define HEAP_SL_LOG2    (4)
+#define HEAP_SL_COUNT   (1 << HEAP_SL_LOG2)
+// sizes below HEAP_SMALL_SIZE all share first level 0, split linearly
+#define HEAP_FL_SHIFT   (HEAP_SL_LOG2 + HEAP_ALIGN_LOG2)
+#define HEAP_SMALL_SIZE (1 << HEAP_FL_SHIFT)
+// blocks are smaller than 2^HEAP_FL_MAX bytes
+#define HEAP_FL_MAX     (30)
+#define HEAP_FL_COUNT   (HEAP_FL_MAX - HEAP_FL_SHIFT + 1)
+
+#define HEAP_BLK_MIN    (HEAP_ALIGN)
+// rounding a request up to its list must not leave the first level range
+#define HEAP_BLK_MAX    ((size_t)1 << (HEAP_FL_MAX - 1))
+
+#define HEAP_ROUND_UP(size) (((size) + (HEAP_ALIGN - 1)) & ~(size_t)(HEAP_ALIGN - 1))
+#define HEAP_PAGE_ROUND_UP(size) (((size) + (VM_PAGE_SIZE - 1)) & ~(size_t)(VM_PAGE_SIZE - 1))
+
+// the heap grows by at least this much at a time, and only shrinks once twice as
+// much is free at its end, so an allocation and free at the boundary do not remap
+#define HEAP_GROW_MIN   (4 * VM_PAGE_SIZE)
+#define HEAP_SHRINK_MIN (2 * HEAP_GROW_MIN)
+
 unsigned char heap_isinit = 0;
-struct mcb* free_head = NULL;
-struct mcb* alloc_head = NULL;
 
-static void* global_heap = NULL;
+// first block of the heap and the zero sized, allocated block closing it
+static struct mcb* heap_first = NULL;
+static struct mcb* heap_sentinel = NULL;
+// end of the pages mapped for the heap, which never shrinks below its initial end
+static uintptr_t heap_end = 0;
+static uintptr_t heap_init_end = 0;
 
-void initialize_heap(size_t size)
+static uint32_t heap_fl_bitmap = 0;
+static uint32_t heap_sl_bitmap[HEAP_FL_COUNT] = { 0 };
+static struct mcb* heap_free_lists[HEAP_FL_COUNT][HEAP_SL_COUNT] = { { NULL } };
+
+// statistics kept up to date by every operation, only the largest free block is
+// looked up when they are read
+static struct heap_stats heap_stats_cur = { 0 };
+
+static inline int heap_fls(size_t size)
 {
-    // there will always be a free block referenced if the heap is initialized
-    if (!heap_isinit)
+    return 31 - __builtin_clz(size);
+}
+
+// bytes a block occupies in addition to its usable space
+#define HEAP_BLK_OVERHEAD (sizeof(struct mcb) + sizeof(struct mcb_tag))
+
+static inline uint32_t heap_check(const struct mcb* mcb, size_t size)
+{
+    return MCB_MAGIC ^ (uint32_t)(uintptr_t)mcb ^ (uint32_t)size;
+}
+
+static inline struct mcb_tag* heap_tag(const struct mcb* mcb)
+{
+    return (struct mcb_tag*)((uintptr_t)mcb + sizeof(struct mcb) + mcb->blk_size);
+}
+
+static inline struct mcb* heap_phys_next(const struct mcb* mcb)
+{
+    return (struct mcb*)((uintptr_t)mcb + HEAP_BLK_OVERHEAD + mcb->blk_size);
+}
+
+// the tag of the preceding block sits right before the header, NULL for the first block
+static inline struct mcb_tag* heap_prev_tag(const struct mcb* mcb)
+{
+    return (mcb == heap_first) ? NULL : (struct mcb_tag*)((uintptr_t)mcb - sizeof(struct mcb_tag));
+}
+
+static inline struct mcb* heap_phys_prev(const struct mcb* mcb, const struct mcb_tag* prev_tag)
+{
+    size_t prev_size = prev_tag->blk_size_inuse & ~MCB_TAG_INUSE;
+    return (struct mcb*)((uintptr_t)mcb - HEAP_BLK_OVERHEAD - prev_size);
+}
+
+// writes the header and tag of a block
+static void heap_blk_set(struct mcb* mcb, size_t size, unsigned char free)
+{
+    mcb->blk_check = heap_check(mcb, size);
+    mcb->blk_size = size;
+    mcb->blk_free = free;
+    heap_tag(mcb)->blk_size_inuse = size | (free ? 0 : MCB_TAG_INUSE);
+}
+
+// list indices a block of the given size is filed under
+static void heap_mapping(size_t size, int* fl, int* sl)
+{
+    if (size < HEAP_SMALL_SIZE)
     {
-        // kmalloc() only checks for a size less than 0x10000 (65536 bytes) via alloc(), 
-        // but this will only called once as the kernel initializes (for the scope of
-        // the project) and so wouldn't be dynamically adjusted.
-        // Just be sure to not pass anything above this size.
-        global_heap = kmalloc(size, 0, NULL);
-        // Entire heap will be a free block, so a control block entry will be created at its beginning.
-        // The free_list is cyclical so set head block to point to itself for p_prev and p_next.
-        free_head = global_heap;
-            free_head->p_prev = NULL;
-            free_head->p_next = NULL;
-            free_head->blk_size = size - sizeof(struct mcb);
-        heap_isinit = 1;
+        *fl = 0;
+        *sl = size / (HEAP_SMALL_SIZE / HEAP_SL_COUNT);
+    }
+    else
+    {
+        int bit = heap_fls(size);
+        *sl = (size >> (bit - HEAP_SL_LOG2)) ^ HEAP_SL_COUNT;
+        *fl = bit - (HEAP_FL_SHIFT - 1);
     }
-    return;
 }
 
-void* allocate_memory(size_t size)
+static void heap_list_insert(struct mcb* mcb)
 {
-    // check that the heap was initialized
-    if (!heap_isinit)
+    int fl, sl;
+    heap_mapping(mcb->blk_size, &fl, &sl);
+    mcb->p_prev = NULL;
+    mcb->p_next = heap_free_lists[fl][sl];
+    if (mcb->p_next != NULL)
     {
-        return NULL;
+        mcb->p_next->p_prev = mcb;
     }
+    heap_free_lists[fl][sl] = mcb;
+    heap_fl_bitmap |= 1u << fl;
+    heap_sl_bitmap[fl] |= 1u << sl;
+    heap_stats_cur.bytes_free += mcb->blk_size;
+    ++heap_stats_cur.free_blocks;
+}
 
-    size_t req_full_blk_size = size + sizeof(struct mcb);
-    unsigned char blk_replace_free = 0;
-    struct mcb* mcb_free_select;
-    // check for a free space via first fit strategy
-    struct mcb* mcb_free_iter = free_head;
-    // iterate through free blocks to find the first from free_next with fit
-    while (mcb_free_iter != NULL)
+static void heap_list_remove(struct mcb* mcb)
+{
+    int fl, sl;
+    heap_mapping(mcb->blk_size, &fl, &sl);
+    if (mcb->p_prev != NULL)
     {
-        // check for ability to fit allocation and another mcb to accompany a new block
-        // If block size is equal to allocation size, the free mcb can be replaced.
-        // Otherwise, if the request would not leave room for an mcb and at least a byte for the next free block
-        // then we can also replace the free mcb, as it makes no sense to have useless space.
-        //  As this is used later, it is cached for later switching.
-        blk_replace_free = (mcb_free_iter->blk_size <= size + sizeof(struct mcb)) &&
-                           (mcb_free_iter->blk_size >= size);
-
-        if ((mcb_free_iter->blk_size >= req_full_blk_size) || blk_replace_free)
-        {
-            // alias for OOS
-            mcb_free_select = mcb_free_iter;
-            goto found_free_block;
-        }
-        mcb_free_iter = mcb_free_iter->p_next;
+        mcb->p_prev->p_next = mcb->p_next;
     }
-    // if, by the end of this loop, no free mcb is selected then no free block can fit request
-    return NULL;
-
-    found_free_block: ;
-    // locate adjacent allocated blocks, if any, to stitch with upon insert
-    struct mcb* mcb_alloc_select_next = alloc_head;
-    struct mcb* mcb_alloc_select = NULL;
-    // check for no allocated blocks
-    if (alloc_head == NULL)
+    else
     {
-        goto skip_alloc_find;
+        heap_free_lists[fl][sl] = mcb->p_next;
     }
-    do
+    if (mcb->p_next != NULL)
     {
-        // the the first allocated block ahead of the selected free block
-        if (mcb_alloc_select_next > mcb_free_select)
-        {
-            break;
-        }
-        mcb_alloc_select = mcb_alloc_select_next;
-        mcb_alloc_select_next = mcb_alloc_select_next->p_next;
-    }
-    while (mcb_alloc_select_next != NULL);
-    skip_alloc_find: ;
-    
-    size_t allocnew_blk_size;
-    // if we aren't replacing, a new free mcb will be made and placed
-    if (!blk_replace_free)
-    {
-        // create new free block ahead of allocation by just moving the old block
-        // offset from selected free mcb, account for mcb space and allocation size
-        struct mcb* mcb_free_new = (struct mcb*)(((void*)mcb_free_select) + req_full_blk_size);
-        // copy old free mcb to new
-        *mcb_free_new = *mcb_free_select;
-        // ensure adjacent entries point to the new free mcb
-        if (mcb_free_new->p_prev != NULL)
-        {
-            mcb_free_new->p_prev->p_next = mcb_free_new;
-        }
-        if (mcb_free_new->p_next != NULL)
+        mcb->p_next->p_prev = mcb->p_prev;
+    }
+    heap_stats_cur.bytes_free -= mcb->blk_size;
+    --heap_stats_cur.free_blocks;
+    // clear the bitmap bits once the list empties
+    if (heap_free_lists[fl][sl] == NULL)
+    {
+        heap_sl_bitmap[fl] &= ~(1u << sl);
+        if (heap_sl_bitmap[fl] == 0)
         {
-            mcb_free_new->p_next->p_prev = mcb_free_new;
+            heap_fl_bitmap &= ~(1u << fl);
         }
-        mcb_free_new->blk_size -= req_full_blk_size;
+    }
+}
 
-        if (mcb_free_select == free_head)
-        {
-            free_head = mcb_free_new;
-        }
-        allocnew_blk_size = size;
+// rounds a request up to the next list boundary, so any block in that list fits it
+static size_t heap_search_size(size_t size)
+{
+    if (size >= HEAP_SMALL_SIZE)
+    {
+        size += ((size_t)1 << (heap_fls(size) - HEAP_SL_LOG2)) - 1;
     }
-    else // replace free mcb
+    return size;
+}
+
+// finds a free block of at least the given size in constant time
+static struct mcb* heap_find_fit(size_t size)
+{
+    int fl, sl;
+    heap_mapping(heap_search_size(size), &fl, &sl);
+    if (fl >= HEAP_FL_COUNT)
+    {
+        return NULL;
+    }
+    // look in the same first level for a larger second level, then in larger first levels
+    uint32_t sl_map = heap_sl_bitmap[fl] & (~0u << sl);
+    if (sl_map == 0)
     {
-        allocnew_blk_size = mcb_free_select->blk_size;
-        if (mcb_free_select == free_head)
+        uint32_t fl_map = heap_fl_bitmap & (~0u << (fl + 1));
+        if (fl_map == 0)
         {
-            free_head = free_head->p_next;
+            return NULL;
         }
+        fl = __builtin_ctz(fl_map);
+        sl_map = heap_sl_bitmap[fl];
     }
+    sl = __builtin_ctz(sl_map);
+    return heap_free_lists[fl][sl];
+}
 
-    struct mcb* mcb_alloc_new = mcb_free_select;
-    mcb_alloc_new->blk_size = allocnew_blk_size;
-    // check if there are other allocated blocks    
-    if (alloc_head != NULL)
+// places the sentinel closing the heap at a new end
+static void heap_set_end(uintptr_t end)
+{
+    heap_end = end;
+    heap_sentinel = (struct mcb*)(end - sizeof(struct mcb));
+    heap_sentinel->blk_check = 0;
+    heap_sentinel->blk_size = 0;
+    heap_sentinel->blk_free = 0;
+}
+
+void initialize_heap(size_t size)
+{
+    if (!heap_isinit && (size <= VM_HEAP_MAX))
     {
-        // insert allocated block into the list of others
-        mcb_alloc_new->p_next = mcb_alloc_select_next;
-        mcb_alloc_new->p_prev = mcb_alloc_select;
-        // check that previous block exists
-        if (mcb_alloc_select != NULL)
+        // the initial heap is backed on demand, so its pages only take frames once
+        // they are touched. pages past it are mapped as the heap grows, so a stray
+        // access beyond the heap still faults
+        size_t pages = HEAP_PAGE_ROUND_UP(size) / VM_PAGE_SIZE;
+        if (pages == 0)
         {
-            mcb_alloc_select->p_next = mcb_alloc_new;
+            pages = 1;
         }
-        if (mcb_alloc_select_next != NULL)
+        if (vm_region_add((void*)VM_HEAP_BASE, pages * VM_PAGE_SIZE) != 0)
         {
-            mcb_alloc_select_next->p_prev = mcb_alloc_new;
+            return;
         }
+        heap_init_end = VM_HEAP_BASE + pages * VM_PAGE_SIZE;
+        // the entire heap starts as one free block, closed by a sentinel header
+        heap_set_end(heap_init_end);
+        heap_first = (struct mcb*)VM_HEAP_BASE;
+        heap_blk_set(heap_first, (uintptr_t)heap_sentinel - VM_HEAP_BASE - HEAP_BLK_OVERHEAD, 1);
+        heap_list_insert(heap_first);
+        heap_isinit = 1;
     }
-    // check for no other blocks (only one free block)
-    else
+    return;
+}
+
+struct mcb* heap_block_first(void)
+{
+    return heap_isinit ? heap_first : NULL;
+}
+
+struct mcb* heap_block_next(const struct mcb* mcb)
+{
+    struct mcb* next = heap_phys_next(mcb);
+    return (next == heap_sentinel) ? NULL : next;
+}
+
+// checks in constant time that a pointer is the start of an allocated block, by
+// its header check value and by its tag agreeing with its header
+static struct mcb* heap_validate(void* ptr)
+{
+    struct mcb* mcb = (struct mcb*)((uintptr_t)ptr - sizeof(struct mcb));
+    if (
+        ((uintptr_t)ptr & (HEAP_ALIGN - 1)) ||
+        ((uintptr_t)mcb < (uintptr_t)heap_first) ||
+        ((uintptr_t)mcb >= (uintptr_t)heap_sentinel) ||
+        (mcb->blk_check != heap_check(mcb, mcb->blk_size)) ||
+        mcb->blk_free ||
+        (mcb->blk_size > (uintptr_t)heap_sentinel - (uintptr_t)ptr - sizeof(struct mcb_tag)) ||
+        (heap_tag(mcb)->blk_size_inuse != (mcb->blk_size | MCB_TAG_INUSE))
+    )
     {
-        alloc_head = mcb_alloc_new;
-        mcb_alloc_new->p_next = NULL;
-        mcb_alloc_new->p_prev = NULL;
+        return NULL;
     }
+    return mcb;
+}
 
-    return (void*)mcb_alloc_new + sizeof(struct mcb);
+// merges a block that is not in a free list with its free physical neighbours,
+// then files the result as free
+static void heap_coalesce_insert(struct mcb* mcb)
+{
+    size_t blk_size = mcb->blk_size;
+
+    // merge with the physically following block if it is free
+    struct mcb* mcb_next = heap_phys_next(mcb);
+    if ((mcb_next != heap_sentinel) && mcb_next->blk_free)
+    {
+        heap_list_remove(mcb_next);
+        blk_size += HEAP_BLK_OVERHEAD + mcb_next->blk_size;
+        // absorbed headers must no longer validate
+        mcb_next->blk_check = 0;
+    }
+    // merge into the physically preceding block if its tag says it is free
+    struct mcb_tag* prev_tag = heap_prev_tag(mcb);
+    if ((prev_tag != NULL) && !(prev_tag->blk_size_inuse & MCB_TAG_INUSE))
+    {
+        struct mcb* mcb_prev = heap_phys_prev(mcb, prev_tag);
+        heap_list_remove(mcb_prev);
+        blk_size += HEAP_BLK_OVERHEAD + mcb_prev->blk_size;
+        mcb->blk_check = 0;
+        mcb = mcb_prev;
+    }
+    heap_blk_set(mcb, blk_size, 1);
+    heap_list_insert(mcb);
 }
 
-int free_memory(void* ptr)
+// extends the heap past its end by a free block a request of the given size fits in
+static int heap_grow(size_t size)
 {
-    // check that the heap was initialized
-    if (!heap_isinit)
+    size_t grow = HEAP_PAGE_ROUND_UP(heap_search_size(size) + HEAP_BLK_OVERHEAD);
+    if (grow < HEAP_GROW_MIN)
     {
-        return 1;
+        grow = HEAP_GROW_MIN;
+    }
+    if (grow > VM_HEAP_BASE + VM_HEAP_MAX - heap_end)
+    {
+        return -1;
+    }
+    // back the new pages now, so running out of frames fails this request rather
+    // than a later access to pages earlier grows counted on as well
+    if (vm_map((void*)heap_end, grow / VM_PAGE_SIZE) != 0)
+    {
+        return -1;
     }
+    memset((void*)heap_end, 0, grow);
+    // the old sentinel becomes the header of a block spanning the new pages
+    struct mcb* mcb_new = heap_sentinel;
+    heap_set_end(heap_end + grow);
+    heap_blk_set(mcb_new, (uintptr_t)heap_sentinel - (uintptr_t)mcb_new - HEAP_BLK_OVERHEAD, 0);
+    heap_coalesce_insert(mcb_new);
+    return 0;
+}
 
-    // Get an mcb pointer for the allocated block, which may or may not be valid
-    struct mcb* mcb_alloc_tofree = (struct mcb*)((void*)ptr - sizeof(struct mcb));
+// unmaps whole pages at the end of the heap that a free block ending the heap spans
+static void heap_shrink(void)
+{
+    struct mcb_tag* last_tag = heap_prev_tag(heap_sentinel);
+    if ((last_tag == NULL) || (last_tag->blk_size_inuse & MCB_TAG_INUSE))
+    {
+        return;
+    }
+    struct mcb* mcb_last = heap_phys_prev(heap_sentinel, last_tag);
+    // the last block keeps room for its header, tag, a minimal size and the sentinel
+    uintptr_t end = HEAP_PAGE_ROUND_UP((uintptr_t)mcb_last + HEAP_BLK_OVERHEAD + HEAP_BLK_MIN + sizeof(struct mcb));
+    if (end < heap_init_end)
+    {
+        end = heap_init_end;
+    }
+    if (end + HEAP_SHRINK_MIN > heap_end)
+    {
+        return;
+    }
+    size_t pages = (heap_end - end) / VM_PAGE_SIZE;
+    heap_list_remove(mcb_last);
+    heap_set_end(end);
+    heap_blk_set(mcb_last, (uintptr_t)heap_sentinel - (uintptr_t)mcb_last - HEAP_BLK_OVERHEAD, 1);
+    heap_list_insert(mcb_last);
+    vm_unmap((void*)end, pages);
+}
 
-    // Attempt to find the mcb pointer in the allocated list
-    struct mcb* mcb_alloc_iter = alloc_head;
-    while (mcb_alloc_iter != NULL)
+// histogram bucket of a requested size, by the power of two it rounds up to
+static inline unsigned int heap_hist_bucket(size_t size)
+{
+    if (size <= MPX_HEAP_HIST_MIN)
+    {
+        return 0;
+    }
+    unsigned int bucket = heap_fls(size - 1) + 1 - heap_fls(MPX_HEAP_HIST_MIN);
+    return (bucket < MPX_HEAP_HIST_BUCKETS) ? bucket : MPX_HEAP_HIST_BUCKETS - 1;
+}
+
+static void* heap_allocate(size_t size)
+{
+    // check that the heap was initialized
+    if (!heap_isinit || (size > HEAP_BLK_MAX))
     {
-        //Check if desired allocated block has been found
+        ++heap_stats_cur.fails;
+        return NULL;
+    }
+    ++heap_stats_cur.size_hist[heap_hist_bucket(size)];
+    size = HEAP_ROUND_UP(size);
+    if (size < HEAP_BLK_MIN)
+    {
+        size = HEAP_BLK_MIN;
+    }
 
-        if (mcb_alloc_iter == mcb_alloc_tofree)
+    struct mcb* mcb_select = heap_find_fit(size);
+    if (mcb_select == NULL)
+    {
+        if (heap_grow(size) != 0)
         {
-            break;
+            ++heap_stats_cur.fails;
+            return NULL;
         }
-        //Otherwise continue
-        mcb_alloc_iter = mcb_alloc_iter->p_next;
+        mcb_select = heap_find_fit(size);
     }
-    // If alloc_iter is null, then the block was not found, i.e. invalid pointer to free.
-    if (mcb_alloc_iter == NULL)
+    heap_list_remove(mcb_select);
+
+    // split off the remainder as a new free block if it can hold one
+    size_t blk_size = mcb_select->blk_size;
+    if (blk_size >= size + HEAP_BLK_OVERHEAD + HEAP_BLK_MIN)
+    {
+        struct mcb* mcb_rest = (struct mcb*)((uintptr_t)mcb_select + HEAP_BLK_OVERHEAD + size);
+        heap_blk_set(mcb_rest, blk_size - size - HEAP_BLK_OVERHEAD, 1);
+        heap_list_insert(mcb_rest);
+        blk_size = size;
+    }
+    heap_blk_set(mcb_select, blk_size, 0);
+    heap_stats_cur.bytes_in_use += blk_size;
+    ++heap_stats_cur.used_blocks;
+    ++heap_stats_cur.allocs;
+    return (void*)mcb_select + sizeof(struct mcb);
+}
+
+static int heap_free(void* ptr)
+{
+    // check that the heap was initialized
+    if (!heap_isinit)
     {
         return 1;
     }
 
-    // Remove the allocated block mcb from the list
-    // Check if selected head of the list
-    if (mcb_alloc_tofree == alloc_head)
+    // wild pointers and double frees are rejected
+    struct mcb* mcb_tofree = heap_validate(ptr);
+    if (mcb_tofree == NULL)
     {
-        // This accounts for head being last allocated block mcb
-        alloc_head = mcb_alloc_tofree->p_next;
+        return 1;
     }
-    else // Not at the head of the list, so guaranteed p_prev is not null
+    heap_stats_cur.bytes_in_use -= mcb_tofree->blk_size;
+    --heap_stats_cur.used_blocks;
+    ++heap_stats_cur.frees;
+    heap_coalesce_insert(mcb_tofree);
+    heap_shrink();
+    return 0;
+}
+
+#if MPX_HEAP_TRACE
+// the last MPX_HEAP_TRACE_LEN heap operations, oldest overwritten first
+struct heap_trace_rec {
+    uint64_t tsc;
+    uintptr_t ptr;
+    uint32_t size;
+    char op;
+};
+
+static struct heap_trace_rec heap_trace_ring[MPX_HEAP_TRACE_LEN];
+static uint32_t heap_trace_count = 0;
+// set while dumping, so the dump neither records its own allocations nor races them
+static unsigned char heap_trace_paused = 0;
+
+_Static_assert((MPX_HEAP_TRACE_LEN & (MPX_HEAP_TRACE_LEN - 1)) == 0, "trace length must be a power of two");
+
+static inline void heap_trace_record(char op, size_t size, void* ptr)
+{
+    if (!heap_trace_paused)
     {
-        mcb_alloc_tofree->p_prev->p_next = mcb_alloc_tofree->p_next;
+        struct heap_trace_rec* rec = &heap_trace_ring[heap_trace_count++ & (MPX_HEAP_TRACE_LEN - 1)];
+        rec->tsc = rdtsc();
+        rec->ptr = (uintptr_t)ptr;
+        rec->size = (uint32_t)size;
+        rec->op = op;
     }
-    // Check if not selected end of the list
-    if (mcb_alloc_tofree->p_next != NULL)
+}
+
+// size of the block a pointer to free refers to, taken before freeing while the
+// header is still known valid
+static size_t heap_trace_blk_size(void* ptr)
+{
+    struct mcb* mcb = heap_validate(ptr);
+    return (mcb != NULL) ? mcb->blk_size : 0;
+}
+
+static size_t heap_trace_hex(char* str, uintptr_t value)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    str[0] = '0';
+    str[1] = 'x';
+    for (int i = 0; i < 8; ++i)
     {
-        mcb_alloc_tofree->p_next->p_prev = mcb_alloc_tofree->p_prev;
+        str[9 - i] = digits[(value >> (i * 4)) & 0xF];
     }
-    // Allocated block is now removed from the allocated list
-    // Merge selected block into adjacent free spaces
-    struct mcb* mcb_free_select_next = free_head;
-    struct mcb* mcb_free_select = NULL;
-    // Find free blocks adjacent to the block to free
-    // Check for no free space
-    if (free_head == NULL)
+    return 10;
+}
+
+int heap_trace_dump(device dev)
+{
+    preempt_disable();
+    heap_trace_paused = 1;
+    uint32_t count = heap_trace_count;
+    preempt_enable();
+
+    uint32_t first = (count > MPX_HEAP_TRACE_LEN) ? count - MPX_HEAP_TRACE_LEN : 0;
+    char line[64];
+    size_t len = 0;
+    memcpy(line, "heap_trace begin n=", 19);
+    len = 19;
+    itoa(&line[len], (int)(count - first));
+    len += strlen(&line[len]);
+    memcpy(&line[len], " dropped=", 9);
+    len += 9;
+    itoa(&line[len], (int)first);
+    len += strlen(&line[len]);
+    line[len++] = '\r';
+    line[len++] = '\n';
+    write(dev, line, len);
+
+    // one line per operation, "A size ptr tsc" or "F size ptr tsc"
+    for (uint32_t i = first; i != count; ++i)
     {
-        goto skip_free_find;
+        const struct heap_trace_rec* rec = &heap_trace_ring[i & (MPX_HEAP_TRACE_LEN - 1)];
+        len = 0;
+        line[len++] = rec->op;
+        line[len++] = ' ';
+        itoa(&line[len], (int)rec->size);
+        len += strlen(&line[len]);
+        line[len++] = ' ';
+        len += heap_trace_hex(&line[len], rec->ptr);
+        line[len++] = ' ';
+        u64toa(&line[len], rec->tsc);
+        len += strlen(&line[len]);
+        line[len++] = '\r';
+        line[len++] = '\n';
+        write(dev, line, len);
     }
-    do
+    write(dev, "heap_trace end\r\n", 16);
+
+    preempt_disable();
+    heap_trace_paused = 0;
+    preempt_enable();
+    return 0;
+}
+#define HEAP_TRACE_RECORD(op, size, ptr) heap_trace_record((op), (size), (ptr))
+#else
+int heap_trace_dump(device dev)
+{
+    (void)dev;
+    return -1;
+}
+#define HEAP_TRACE_RECORD(op, size, ptr)
+#endif
+
+void heap_stats_get(struct heap_stats* stats)
+{
+    preempt_disable();
+    *stats = heap_stats_cur;
+    stats->bytes_heap = heap_isinit ? heap_end - VM_HEAP_BASE : 0;
+    // the largest free block is in the highest non-empty list
+    stats->largest_free = 0;
+    if (heap_fl_bitmap != 0)
     {
-        if (mcb_alloc_tofree < mcb_free_select_next)
+        int fl = heap_fls(heap_fl_bitmap);
+        int sl = heap_fls(heap_sl_bitmap[fl]);
+        for (struct mcb* mcb = heap_free_lists[fl][sl]; mcb != NULL; mcb = mcb->p_next)
         {
-            break;
+            if (mcb->blk_size > stats->largest_free)
+            {
+                stats->largest_free = mcb->blk_size;
+            }
         }
-        mcb_free_select = mcb_free_select_next;
-        mcb_free_select_next = mcb_free_select_next->p_next;
     }
-    while (mcb_free_select_next != NULL);
-    skip_free_find: ;
+    preempt_enable();
+    // free space outside the largest block cannot serve a request that large.
+    // scaled down so the ratio needs no 64-bit division
+    uint32_t outside = stats->bytes_free - stats->largest_free;
+    uint32_t total = stats->bytes_free;
+    while (total > UINT32_MAX / 1000)
+    {
+        outside >>= 1;
+        total >>= 1;
+    }
+    stats->frag_permille = (total == 0) ? 0 : outside * 1000 / total;
+}
+
+#if MPX_HEAP_PROFILE
+// entries in use come first, the last entry collects sites that find the table full
+static struct heap_profile_site heap_profile_sites[MPX_HEAP_PROFILE_SITES];
+static unsigned int heap_profile_count = 0;
+// call site hint for allocations made before any process runs
+static void* heap_profile_boot_site = NULL;
 
-    // If no free blocks exist, just convert the mcb to a free block
-    if (free_head == NULL)
+void heap_profile_set_site(void* site)
+{
+    preempt_disable();
+    if (pcb_running != NULL)
     {
-        free_head = mcb_alloc_tofree;
-        mcb_alloc_tofree->p_next = NULL;
-        mcb_alloc_tofree->p_prev = NULL;
-        return 0;
+        pcb_running->alloc_site = site;
+    }
+    else
+    {
+        heap_profile_boot_site = site;
+    }
+    preempt_enable();
+}
+
+// charges a new block to its call site, preferring a site recorded by a wrapper
+static void heap_profile_alloc(void* ptr, void* ret)
+{
+    if (ptr == NULL)
+    {
+        return;
     }
-    // make the mcb free and merge other free blocks
-    // at least one free block exists is selected
-    if (mcb_free_select != NULL)
+    void* site = (pcb_running != NULL) ? pcb_running->alloc_site : heap_profile_boot_site;
+    if (site == NULL)
     {
-        // check adjacency behind target block for backward merge at least
-        if ((void*)mcb_free_select + sizeof(struct mcb) + mcb_free_select->blk_size == mcb_alloc_tofree)
+        site = ret;
+    }
+    unsigned int pid = (pcb_running != NULL) ? pcb_running->pid : 0;
+    unsigned int slot = 0;
+    while ((slot < heap_profile_count)
+        && ((heap_profile_sites[slot].site != site) || (heap_profile_sites[slot].pid != pid)))
+    {
+        ++slot;
+    }
+    if (slot == heap_profile_count)
+    {
+        if (heap_profile_count < MPX_HEAP_PROFILE_SITES - 1)
         {
-            mcb_free_select->blk_size += mcb_alloc_tofree->blk_size + sizeof(struct mcb);
-            if (mcb_free_select_next != NULL)
-            {
-                // check adjacency of forward free block for backward + forward merge
-                if ((void*)mcb_alloc_tofree + sizeof(struct mcb) + mcb_alloc_tofree->blk_size == mcb_free_select_next)
-                {
-                    mcb_free_select->blk_size += mcb_free_select_next->blk_size + sizeof(struct mcb);
-                    mcb_free_select->p_next = mcb_free_select_next->p_next;
-                    if (mcb_free_select_next->p_next != NULL)
-                    {
-                        mcb_free_select_next->p_next->p_prev = mcb_free_select;
-                    }
-                }
-            }
-            else
-            {
-                mcb_free_select->p_next = NULL;
-            }
+            heap_profile_sites[slot].site = site;
+            heap_profile_sites[slot].pid = pid;
+            ++heap_profile_count;
         }
-        else // no adjacency, so no backward merge, operate on original target and check forward merging
+        else
         {
-            mcb_alloc_tofree->p_prev = mcb_free_select;
-            if (mcb_free_select_next != NULL)
-            {
-                if ((void*)mcb_alloc_tofree + sizeof(struct mcb) + mcb_alloc_tofree->blk_size == mcb_free_select_next)
-                {
-                    mcb_alloc_tofree->blk_size += mcb_free_select_next->blk_size + sizeof(struct mcb);
-                    mcb_alloc_tofree->p_next = mcb_free_select_next->p_next;
-                    if (mcb_free_select_next->p_next != NULL)
-                    {
-                        mcb_free_select_next->p_next->p_prev = mcb_alloc_tofree;
-                    }
-                }
-                else // no merge
-                {
-                    mcb_alloc_tofree->p_next = mcb_free_select_next;
-                    mcb_free_select_next->p_prev = mcb_alloc_tofree;
-                }
-
-                // account for the head and set the head accordingly
-                if (mcb_free_select_next == free_head)
-                {
-                    free_head = mcb_alloc_tofree;
-                }
-            }
+            slot = MPX_HEAP_PROFILE_SITES - 1;
         }
     }
-    else // mcb_free_select_next will be valid, newly freed block will become free_head
+    struct mcb* mcb = (struct mcb*)((uintptr_t)ptr - sizeof(struct mcb));
+    mcb->prof_slot = (unsigned char)slot;
+    heap_profile_sites[slot].live_bytes += mcb->blk_size;
+    ++heap_profile_sites[slot].live_count;
+    ++heap_profile_sites[slot].allocs;
+}
+
+// releases the charge of a block about to be freed, if it is a valid allocation
+static void heap_profile_free(void* ptr)
+{
+    struct mcb* mcb = heap_validate(ptr);
+    if (mcb != NULL)
     {
-        mcb_alloc_tofree->p_prev = NULL;
-        // attempt only forward merge
-        // check adjacency of forward free block for forward merge 
-        if ((void*)mcb_alloc_tofree + sizeof(struct mcb) + mcb_alloc_tofree->blk_size == mcb_free_select_next)
+        heap_profile_sites[mcb->prof_slot].live_bytes -= mcb->blk_size;
+        --heap_profile_sites[mcb->prof_slot].live_count;
+    }
+}
+
+int heap_profile_get(struct heap_profile_site* sites, int max)
+{
+    int count = 0;
+    preempt_disable();
+    for (unsigned int i = 0; i < MPX_HEAP_PROFILE_SITES; ++i)
+    {
+        const struct heap_profile_site* entry = &heap_profile_sites[i];
+        if ((i >= heap_profile_count) && (entry->allocs == 0))
+        {
+            continue;
+        }
+        // insertion sort by live bytes, dropping whatever falls off the end
+        int pos = (count < max) ? count++ : max;
+        while ((pos > 0) && (sites[pos - 1].live_bytes < entry->live_bytes))
         {
-            mcb_alloc_tofree->blk_size += mcb_free_select_next->blk_size + sizeof(struct mcb);
-            mcb_alloc_tofree->p_next = mcb_free_select_next->p_next;
-            if (mcb_free_select_next->p_next != NULL)
+            if (pos < max)
             {
-                mcb_free_select_next->p_next->p_prev = mcb_alloc_tofree;
+                sites[pos] = sites[pos - 1];
             }
+            --pos;
         }
-        else // no merge
+        if (pos < max)
         {
-            mcb_alloc_tofree->p_next = mcb_free_select_next;
-            mcb_free_select_next->p_prev = mcb_alloc_tofree;
+            sites[pos] = *entry;
         }
-
-        free_head = mcb_alloc_tofree;
     }
+    preempt_enable();
+    return count;
+}
+#define HEAP_PROFILE_ALLOC(ptr, ret) heap_profile_alloc((ptr), (ret))
+#define HEAP_PROFILE_FREE(ptr) heap_profile_free(ptr)
+#else
+void heap_profile_set_site(void* site)
+{
+    (void)site;
+}
 
-    return 0;
+int heap_profile_get(struct heap_profile_site* sites, int max)
+{
+    (void)sites;
+    (void)max;
+    return -1;
+}
+#define HEAP_PROFILE_ALLOC(ptr, ret)
+#define HEAP_PROFILE_FREE(ptr)
+#endif
+
+// the heap is shared by all processes, so keep the timer from switching away mid-operation
+void* allocate_memory(size_t size)
+{
+    preempt_disable();
+    void* blk = heap_allocate(size);
+    HEAP_TRACE_RECORD('A', size, blk);
+    HEAP_PROFILE_ALLOC(blk, __builtin_return_address(0));
+    preempt_enable();
+    return blk;
+}
+
+int free_memory(void* ptr)
+{
+    preempt_disable();
+    HEAP_TRACE_RECORD('F', heap_trace_blk_size(ptr), ptr);
+    HEAP_PROFILE_FREE(ptr);
+    int ret = heap_free(ptr);
+    preempt_enable();
+    return ret;
 }
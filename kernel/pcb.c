@@ -5,112 +5,307 @@
 #include <string.h>
 #include <memory.h>
 #include <stdlib.h>
+#include <mpx/timer.h>
+#include <mpx/fpu.h>
+#include <mpx/tsc.h>
+#include <mpx/slab.h>
+#include <mpx/memory.h>
+#include <mpx/arena.h>
 
 
 #ifndef MPX_PROC_USE_ALT_QUEUES
 struct pcb_queue pcb_queues[] = {
-    { NULL, NULL, 1 }, // ACTIVE READY
-    { NULL, NULL, 0 }, // ACTIVE BLOCKED
-    { NULL, NULL, 1 }, // SUSPENDED READY
-    { NULL, NULL, 0 }, // SUSPENDED BLOCKED
+    { { { NULL, NULL } }, 0, 1 }, // ACTIVE READY
+    { { { NULL, NULL } }, 0, 0 }, // ACTIVE BLOCKED
+    { { { NULL, NULL } }, 0, 1 }, // SUSPENDED READY
+    { { { NULL, NULL } }, 0, 0 }, // SUSPENDED BLOCKED
 };
 #endif
 
 struct pcb* pcb_running = NULL;
 
-void pcb_insert(struct pcb* pcb_in)
+// process table, chained hash indices over all set up pcbs by name and by pid
+static struct pcb* pcb_name_index[MPX_PCB_TABLE_BUCKETS] = { NULL };
+static struct pcb* pcb_pid_index[MPX_PCB_TABLE_BUCKETS] = { NULL };
+static unsigned int pcb_pid_next = 1;
+
+#define PCB_PID_BUCKET(pid) ((pid) & (MPX_PCB_TABLE_BUCKETS - 1))
+
+// FNV-1a over a NUL-terminated name
+static unsigned int pcb_name_bucket(const char* name)
 {
-    struct pcb_queue* queue = &pcb_queues[PSTATE_QUEUE_SELECTOR(pcb_in->state)];
-    
-    if (queue->pcb_head != NULL)
+    uint32_t hash = 2166136261u;
+    while (*name != '\0')
+    {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash & (MPX_PCB_TABLE_BUCKETS - 1);
+}
+
+static void pcb_table_add(struct pcb* pcb)
+{
+    // hand out the next unused pid, skipping 0 and any still held after wrapping around
+    do
     {
-        if (queue->pcb_head->p_next == NULL) // size == 1
+        pcb->pid = pcb_pid_next++;
+    }
+    while ((pcb->pid == 0) || (pcb_find_pid(pcb->pid) != NULL));
+
+    unsigned int bucket = pcb_name_bucket(pcb->name);
+    pcb->p_name_next = pcb_name_index[bucket];
+    pcb_name_index[bucket] = pcb;
+
+    bucket = PCB_PID_BUCKET(pcb->pid);
+    pcb->p_pid_next = pcb_pid_index[bucket];
+    pcb_pid_index[bucket] = pcb;
+}
+
+static void pcb_table_remove(struct pcb* pcb)
+{
+    struct pcb** link = &pcb_name_index[pcb_name_bucket(pcb->name)];
+    while (*link != NULL)
+    {
+        if (*link == pcb)
         {
-            // check if selected queue is a priority queue
-            if (queue->ispriority)
-            {
-                // check incoming pcb has greater priority 
-                if (pcb_in->state.pri < queue->pcb_head->state.pri)
-                {
-                    // place node at head (higher priority)
-                    // note head is also tail here so no need to assign
-                    pcb_in->p_next = queue->pcb_head;
-                    queue->pcb_head = pcb_in;
-                }
-                else
-                {
-                    goto insert_tail;
-                }
-            }
-            else // not priority queue (or lesser priority) so place at tail
-            {
-                insert_tail: ;
-                queue->pcb_head->p_next = pcb_in;
-                queue->pcb_tail = pcb_in;
-            }
+            *link = pcb->p_name_next;
+            break;
         }
-        else // size > 1
+        link = &(*link)->p_name_next;
+    }
+    link = &pcb_pid_index[PCB_PID_BUCKET(pcb->pid)];
+    while (*link != NULL)
+    {
+        if (*link == pcb)
         {
-            if (queue->ispriority)
-            {
-                struct pcb* prevcmpnode = NULL;
-                struct pcb* cmpnode = queue->pcb_head;
-                // iterate past greater or equal priorities to insert pcb before other pcbs of the same priority
-                while (pcb_in->state.pri >= cmpnode->state.pri)
-                {
-                    prevcmpnode = cmpnode;
-                    cmpnode = cmpnode->p_next;
-                    // check if forward node is past the tail
-                    if (cmpnode == NULL)
-                    {
-                        // go to the tail insertion case
-                        goto pri_iterend;
-                    }
-                }
-                // loop exits normally if the priority of pcb in reaches the
-                //   front of pcbs with it's priority queue
-                // insert between nodes or at head
-                if (cmpnode == queue->pcb_head) // at head
-                {
-                    pcb_in->p_next = queue->pcb_head;
-                    queue->pcb_head = pcb_in;
-                }
-                else  // between nodes
-                {
-                    prevcmpnode->p_next = pcb_in;
-                    pcb_in->p_next = cmpnode;
-                }
-            }
-            else
-            {
-                // insert at tail
-                pri_iterend: ;
-                queue->pcb_tail->p_next = pcb_in;
-                queue->pcb_tail = pcb_in;
-            }
+            *link = pcb->p_pid_next;
+            break;
         }
+        link = &(*link)->p_pid_next;
+    }
+}
+
+// level a pcb belongs to within a queue, non-priority queues keep a single FIFO
+#define PCB_QUEUE_LEVEL(queue, pcb) ((queue)->ispriority ? (pcb)->state.pri : 0)
+
+// unlinks a pcb from the queue and level it was inserted into
+static void pcb_unlink(struct pcb* pcb)
+{
+    struct pcb_queue* queue = pcb->p_queue;
+    struct pcb_queue_level* level = &queue->levels[pcb->p_level];
+
+    if (pcb->p_prev != NULL)
+    {
+        pcb->p_prev->p_next = pcb->p_next;
+    }
+    else // at head
+    {
+        level->pcb_head = pcb->p_next;
+    }
+    if (pcb->p_next != NULL)
+    {
+        pcb->p_next->p_prev = pcb->p_prev;
+    }
+    else // at tail
+    {
+        level->pcb_tail = pcb->p_prev;
+    }
+    // level is now empty
+    if (level->pcb_head == NULL)
+    {
+        queue->level_bitmap &= ~(1 << pcb->p_level);
+    }
+    pcb->p_next = NULL;
+    pcb->p_prev = NULL;
+    pcb->p_queue = NULL;
+}
+
+void pcb_acct_update(struct pcb* pcb)
+{
+    uint64_t now = rdtsc();
+    uint64_t elapsed = now - pcb->acct.state_since;
+    switch (pcb->state.exec)
+    {
+        case PCB_EXEC_RUNNING:
+            pcb->acct.run_cycles += elapsed;
+            break;
+        case PCB_EXEC_READY:
+            pcb->acct.ready_cycles += elapsed;
+            break;
+        default:
+            pcb->acct.blocked_cycles += elapsed;
+            break;
+    }
+    pcb->acct.state_since = now;
+}
+
+void pcb_set_exec(struct pcb* pcb, enum ProcExecState exec)
+{
+    pcb_acct_update(pcb);
+    if (exec == PCB_EXEC_RUNNING)
+    {
+        ++pcb->acct.dispatches;
+    }
+    pcb->state.exec = exec;
+}
+
+void pcb_insert(struct pcb* pcb_in)
+{
+    struct pcb_queue* queue = &pcb_queues[PSTATE_QUEUE_SELECTOR(pcb_in->state)];
+    unsigned char lvl = PCB_QUEUE_LEVEL(queue, pcb_in);
+    struct pcb_queue_level* level = &queue->levels[lvl];
+
+    preempt_disable();
+    // insert at the tail of the level so pcbs of the same priority stay in arrival order
+    pcb_in->p_next = NULL;
+    pcb_in->p_prev = level->pcb_tail;
+    if (level->pcb_head != NULL)
+    {
+        level->pcb_tail->p_next = pcb_in;
     }
     else // size == 0
     {
-        queue->pcb_head = pcb_in;
-        queue->pcb_tail = pcb_in;
+        level->pcb_head = pcb_in;
+        queue->level_bitmap |= (1 << lvl);
     }
+    level->pcb_tail = pcb_in;
+    pcb_in->p_queue = queue;
+    pcb_in->p_level = lvl;
+    preempt_enable();
     return;
 }
 
+struct pcb* pcb_queue_front(const struct pcb_queue* queue)
+{
+    if (queue->level_bitmap == 0)
+    {
+        return NULL;
+    }
+    // lowest set bit is the highest priority non-empty level
+    return queue->levels[__builtin_ctz(queue->level_bitmap)].pcb_head;
+}
+
+struct pcb* pcb_queue_next(const struct pcb_queue* queue, const struct pcb* pcb)
+{
+    if (pcb->p_next != NULL)
+    {
+        return pcb->p_next;
+    }
+    // end of the level, move on to the next non-empty level of lower priority
+    unsigned short lower = queue->level_bitmap & ~((2 << PCB_QUEUE_LEVEL(queue, pcb)) - 1);
+    if (lower == 0)
+    {
+        return NULL;
+    }
+    return queue->levels[__builtin_ctz(lower)].pcb_head;
+}
+
+struct pcb* pcb_next_ready(void)
+{
+    struct pcb_queue* queue = &pcb_queues[0];
+    if (queue->level_bitmap == 0)
+    {
+        return NULL;
+    }
+    // dequeue the head of the highest priority level
+    struct pcb* pcb_rmv = queue->levels[__builtin_ctz(queue->level_bitmap)].pcb_head;
+    pcb_unlink(pcb_rmv);
+    return pcb_rmv;
+}
+
+// a cached pcb, kept with the state needed to recycle it and its stack
+struct pcb_slot {
+    struct pcb pcb; // must be first, cached pcbs are cast back to their slot
+    struct pcb_slot* p_dirty_next;
+    struct pcb_slot* p_dirty_prev;
+    unsigned char dirty; // stack has been used since it was last zeroed
+};
+
+// free slots whose stacks still need zeroing
+static struct pcb_slot* pcb_dirty = NULL;
+// slot of a process that freed itself on EXIT, still on its stack until the switch away
+static struct pcb_slot* pcb_zombie = NULL;
+
+static void pcb_dirty_unlink(struct pcb_slot* slot)
+{
+    if (slot->p_dirty_prev != NULL)
+    {
+        slot->p_dirty_prev->p_dirty_next = slot->p_dirty_next;
+    }
+    else
+    {
+        pcb_dirty = slot->p_dirty_next;
+    }
+    if (slot->p_dirty_next != NULL)
+    {
+        slot->p_dirty_next->p_dirty_prev = slot->p_dirty_prev;
+    }
+    slot->dirty = 0;
+}
+
+// every slot carries its stack for as long as its slab exists
+static int pcb_slot_ctor(void* obj)
+{
+    struct pcb_slot* slot = obj;
+    slot->pcb.pstackseg = allocate_memory(MPX_PCB_STACK_SZ);
+    if (slot->pcb.pstackseg == NULL)
+    {
+        return -1;
+    }
+    memset(slot->pcb.pstackseg, 0, MPX_PCB_STACK_SZ);
+    slot->dirty = 0;
+    return 0;
+}
+
+static void pcb_slot_dtor(void* obj)
+{
+    struct pcb_slot* slot = obj;
+    if (slot->dirty)
+    {
+        pcb_dirty_unlink(slot);
+    }
+    free_memory(slot->pcb.pstackseg);
+}
+
+static struct slab_cache pcb_cache = SLAB_CACHE_INIT("pcb", struct pcb_slot, pcb_slot_ctor, pcb_slot_dtor);
+
+int pcb_pool_init(size_t capacity)
+{
+    return slab_reserve(&pcb_cache, capacity);
+}
+
+int pcb_pool_scrub(void)
+{
+    preempt_disable();
+    struct pcb_slot* slot = pcb_dirty;
+    if (slot != NULL)
+    {
+        pcb_dirty_unlink(slot);
+        memset(slot->pcb.pstackseg, 0, MPX_PCB_STACK_SZ);
+    }
+    preempt_enable();
+    return (slot != NULL);
+}
+
 struct pcb* pcb_allocate(void) {
-    struct pcb* pcb_new = sys_alloc_mem(sizeof(struct pcb));
-    if (pcb_new != NULL)
+    struct pcb_slot* slot = slab_alloc(&pcb_cache);
+    if (slot == NULL)
     {
-        pcb_new->pstackseg = sys_alloc_mem(MPX_PCB_STACK_SZ);
-        if (pcb_new->pstackseg != NULL)
-        {
-            memset(pcb_new->pstackseg, 0, MPX_PCB_STACK_SZ);
-            return pcb_new;
-        }
-        sys_free_mem(pcb_new);
+        return NULL;
     }
-    return NULL;
+    // a recycled stack not yet zeroed while idle is zeroed now
+    preempt_disable();
+    unsigned char dirty = slot->dirty;
+    if (dirty)
+    {
+        pcb_dirty_unlink(slot);
+    }
+    preempt_enable();
+    if (dirty)
+    {
+        memset(slot->pcb.pstackseg, 0, MPX_PCB_STACK_SZ);
+    }
+    return &slot->pcb;
 }
 
 struct pcb* pcb_setup(const char* name, enum ProcClassState cls, unsigned char pri) {
@@ -132,12 +327,26 @@ struct pcb* pcb_setup(const char* name, enum ProcClassState cls, unsigned char p
             {
                 // initialize pcb fields
                     pcb_new->p_next = NULL;
+                    pcb_new->p_prev = NULL;
+                    pcb_new->p_queue = NULL;
+                    pcb_new->p_timer_slot = NULL;
+                    pcb_new->fpu_used = 0;
+                    memset(&pcb_new->acct, 0, sizeof(pcb_new->acct));
+                    // disabled, as freeing arena memory does not make it reusable
+                    memset(&pcb_new->arena, 0, sizeof(pcb_new->arena));
+#if MPX_HEAP_PROFILE
+                    pcb_new->alloc_site = NULL;
+#endif
+                    pcb_new->acct.state_since = rdtsc();
                     memcpy(pcb_new->name, name, namelen);
                     pcb_new->state.pri = pri;
                     pcb_new->state.exec = PCB_EXEC_READY;
                     pcb_new->state.dpatch = PCB_DPATCH_ACTIVE; 
                     pcb_new->state.cls = cls;
                     pcb_new->pctxt = pcb_new->pstackseg + MPX_PCB_STACK_SZ - 1;
+                preempt_disable();
+                pcb_table_add(pcb_new);
+                preempt_enable();
                 return pcb_new;
             }
         }
@@ -186,95 +395,108 @@ void pcb_context_init(struct pcb* pcb, void* func, void* fargs, size_t fargc) {
 }
 
 int pcb_free(struct pcb* pcb) {
-    if(sys_free_mem(pcb->pstackseg) == 0)
+    preempt_disable();
+    pcb_table_remove(pcb);
+    timer_cancel(pcb);
+    fpu_release(pcb);
+    preempt_enable();
+    // everything the process allocated from its arena goes at once
+    arena_release(&pcb->arena);
+    // recycle the slot, leaving its stack to be zeroed when idle or on reuse
+    struct pcb_slot* slot = (struct pcb_slot*)pcb;
+    void* pstackseg = pcb->pstackseg;
+    memset(pcb, 0, sizeof(struct pcb));
+    pcb->pstackseg = pstackseg;
+    preempt_disable();
+    slot->dirty = 1;
+    slot->p_dirty_prev = NULL;
+    slot->p_dirty_next = pcb_dirty;
+    if (pcb_dirty != NULL)
     {
-        memset(pcb, 0, sizeof(struct pcb));
-        if(sys_free_mem(pcb) == 0)
-        {
-            return 0;
-        }
+        pcb_dirty->p_dirty_prev = slot;
+    }
+    pcb_dirty = slot;
+    if (pcb == pcb_running)
+    {
+        // the stack is still in use, returning the slot could destroy its slab and free the stack
+        pcb_zombie = slot;
+    }
+    else
+    {
+        slab_free(&pcb_cache, slot);
     }
-    return -1;
+    preempt_enable();
+    return 0;
+}
+
+void pcb_reap(void)
+{
+    preempt_disable();
+    if ((pcb_zombie != NULL) && (&pcb_zombie->pcb != pcb_running))
+    {
+        slab_free(&pcb_cache, pcb_zombie);
+        pcb_zombie = NULL;
+    }
+    preempt_enable();
 }
 
 struct pcb* pcb_find(const char* name) {
-    // iterate through all queues in order
-    for (size_t i = 0; i < sizeof(pcb_queues) / sizeof(struct pcb_queue); ++i)
+    // an exiting process could otherwise unlink the entry being visited
+    preempt_disable();
+    struct pcb* pcb_iter = pcb_name_index[pcb_name_bucket(name)];
+    // match name within its bucket
+    while ((pcb_iter != NULL) && (strcmp(name, pcb_iter->name) != 0))
     {
-        struct pcb_queue* queue_curr = &pcb_queues[i];
-        // check that the queue is not empty (size > 0)
-        if (queue_curr->pcb_head != NULL)
-        {
-            struct pcb* pcb_iter = queue_curr->pcb_head;
-            while(1)
-            {
-                // match name
-                if (strcmp(name, pcb_iter->name) == 0) {
-                    return pcb_iter;
-                }
-                if (pcb_iter->p_next == NULL)
-                {
-                    break;
-                }
-                pcb_iter = pcb_iter->p_next;
-            }
-        }
+        pcb_iter = pcb_iter->p_name_next;
     }
-    return NULL;
+    preempt_enable();
+    return pcb_iter;
 }
 
-int pcb_remove(struct pcb* pcb) {
-    // only check the queue where the given pcb may be located according to its state
-    struct pcb_queue* queue_curr = &pcb_queues[PSTATE_QUEUE_SELECTOR(pcb->state)];
-    struct pcb* pcb_rmv;
-    
-    if (queue_curr->pcb_head == NULL)
+struct pcb* pcb_find_pid(unsigned int pid) {
+    preempt_disable();
+    struct pcb* pcb_iter = pcb_pid_index[PCB_PID_BUCKET(pid)];
+    while ((pcb_iter != NULL) && (pcb_iter->pid != pid))
     {
-        return -1;
+        pcb_iter = pcb_iter->p_pid_next;
     }
-    // check if pcb resides at head of the queue
-    if (queue_curr->pcb_head == pcb)
+    preempt_enable();
+    return pcb_iter;
+}
+
+int pcb_remove(struct pcb* pcb) {
+    int ret = -1;
+    preempt_disable();
+    // the pcb records the queue it is on, so there is nothing to search for
+    if (pcb->p_queue != NULL)
     {
-        // head is last element
-        if (queue_curr->pcb_head == queue_curr->pcb_tail)
-        {
-            queue_curr->pcb_tail = NULL;
-        }
-        pcb_rmv = queue_curr->pcb_head;
-        // remove head
-        queue_curr->pcb_head = queue_curr->pcb_head->p_next;
-        pcb_rmv->p_next = NULL;
-        return 0;
+        pcb_unlink(pcb);
+        ret = 0;
     }
-    // if checked head, must check any subsequent pcbs
-    if (queue_curr->pcb_head->p_next == NULL)
+    preempt_enable();
+    return ret;
+}
+
+void* pcb_alloc_mem(size_t size)
+{
+    // the profile charges heap blocks, which arena allocations are not, so it bypasses arenas
+#if !MPX_HEAP_PROFILE
+    struct pcb* pcb = pcb_running;
+    if ((pcb != NULL) && pcb->arena.enabled)
     {
-        return -1;
+        return arena_alloc(&pcb->arena, size);
     }
-    // node_temp is used to check the next node and modify the current node while
-    // keeping the ability to stitch up the queue as a singly linked list.
-    struct pcb* pcb_iter = queue_curr->pcb_head;
-    // check that pcb_iter is not next to the tail as we iterate
-    while (pcb_iter->p_next != NULL)
+#endif
+    return allocate_memory(size);
+}
+
+int pcb_free_mem(void* ptr)
+{
+    struct pcb* pcb = pcb_running;
+    // only an enabled arena served the process's allocations, so only then is it searched
+    if ((pcb != NULL) && pcb->arena.enabled && arena_owns(&pcb->arena, ptr))
     {
-        // check for match
-        if (pcb_iter->p_next == pcb)
-        {
-            // remove node and stitch up queue
-            // reset tail if the removal node is the last in the queue
-            if (pcb_iter->p_next == queue_curr->pcb_tail)
-            {
-                queue_curr->pcb_tail = pcb_iter;
-            }
-            pcb_rmv = pcb_iter->p_next;
-            // remove the node
-            pcb_iter->p_next = pcb_iter->p_next->p_next;
-            pcb_rmv->p_next = NULL;
-            return 0;
-        }
-        // no match so iterate
-        pcb_iter = pcb_iter->p_next;
+        return arena_free(ptr);
     }
-    // node_temp is next to the tail at this point, and thus there are no matches
-    return -1;
+    return free_memory(ptr);
 }
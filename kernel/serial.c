@@ -4,6 +4,7 @@
 #include <mpx/interrupts.h>
 #include <memory.h>
 #include <mpx/sys_req.h>
+#include <mpx/slab.h>
 #include <ctype.h>
 
 enum uart_registers {
@@ -23,6 +24,24 @@ enum uart_registers {
 
 static int initialized[4] = { 0 };
 
+static struct slab_cache iocb_cache = SLAB_CACHE_INIT("iocb", struct iocb, NULL, NULL);
+
+// bits of the line status register
+#define SERIAL_LSR_DATA_READY (1 << 0)
+#define SERIAL_LSR_OVERRUN    (1 << 1)
+#define SERIAL_LSR_THR_EMPTY  (1 << 5) // the transmit FIFO is empty
+
+// records the line status, the read clears it
+static unsigned char serial_line_status(struct dcb* dcb)
+{
+    unsigned char lsr = inb(dcb->dev + LSR);
+    if (lsr & SERIAL_LSR_OVERRUN)
+    {
+        ++dcb->rx_overruns;
+    }
+    return lsr;
+}
+
 static int serial_devno(device dev)
 {
 	switch (dev) {
@@ -64,6 +83,9 @@ int serial_out(device dev, const char *buffer, size_t len)
         return -1;
     }
 	for (size_t i = 0; i < len; i++) {
+		// a byte at a time once the FIFO is empty, as interrupt driven writes may share it
+		while (!(serial_line_status(&serial_dcb_list[dno]) & SERIAL_LSR_THR_EMPTY)) {
+		}
 		outb(dev, buffer[i]);
 	}
 	return (int)len;
@@ -202,12 +224,65 @@ int serial_poll(device dev, char *buffer, size_t len)
 unsigned char serial_rbuffers[4][SERIAL_RBUFFER_SIZE];
 // serial ports start closed
 struct dcb serial_dcb_list[4] = {
-    { COM1, NULL, NULL, (unsigned char*)&serial_rbuffers[0], SERIAL_RBUFFER_SIZE, 0, 0, 0, 0, 0 },
-    { COM2, NULL, NULL, (unsigned char*)&serial_rbuffers[1], SERIAL_RBUFFER_SIZE, 0, 0, 0, 0, 0 },
-    { COM3, NULL, NULL, (unsigned char*)&serial_rbuffers[2], SERIAL_RBUFFER_SIZE, 0, 0, 0, 0, 0 },
-    { COM4, NULL, NULL, (unsigned char*)&serial_rbuffers[3], SERIAL_RBUFFER_SIZE, 0, 0, 0, 0, 0 },
+    { COM1, { NULL, NULL, 0, 0 }, { NULL, NULL, 0, 0 }, (unsigned char*)&serial_rbuffers[0], SERIAL_RBUFFER_SIZE, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0 },
+    { COM2, { NULL, NULL, 0, 0 }, { NULL, NULL, 0, 0 }, (unsigned char*)&serial_rbuffers[1], SERIAL_RBUFFER_SIZE, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0 },
+    { COM3, { NULL, NULL, 0, 0 }, { NULL, NULL, 0, 0 }, (unsigned char*)&serial_rbuffers[2], SERIAL_RBUFFER_SIZE, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0 },
+    { COM4, { NULL, NULL, 0, 0 }, { NULL, NULL, 0, 0 }, (unsigned char*)&serial_rbuffers[3], SERIAL_RBUFFER_SIZE, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0 },
 };
 
+// receive FIFO trigger level (FCR bits 6-7), set with SERIAL_RX_TRIGGER in the Makefile.
+// the same bits select a level four times as high in a 64 byte FIFO, but 56 for 14.
+// input short of the trigger is still delivered by the character timeout interrupt
+#if MPX_SERIAL_RX_TRIGGER == 1
+#define SERIAL_FCR_RX_TRIGGER (0x00)
+#elif MPX_SERIAL_RX_TRIGGER == 4
+#define SERIAL_FCR_RX_TRIGGER (0x40)
+#elif MPX_SERIAL_RX_TRIGGER == 8
+#define SERIAL_FCR_RX_TRIGGER (0x80)
+#elif MPX_SERIAL_RX_TRIGGER == 14
+#define SERIAL_FCR_RX_TRIGGER (0xC0)
+#else
+#error "SERIAL_RX_TRIGGER must be 1, 4, 8 or 14"
+#endif
+
+// FIFO control: enable and clear both FIFOs at the receive trigger level, and the
+// 64 byte FIFO of a 16750, which is only written while the divisor latch is set
+#define SERIAL_FCR_ENABLE (0x07 | SERIAL_FCR_RX_TRIGGER)
+#define SERIAL_FCR_FIFO64 (1 << 5)
+// IIR bits 6-7 read back set once the FIFOs work (16550A and later), bit 5 if they are 64 bytes
+#define SERIAL_IIR_FIFO_OK (0xC0)
+#define SERIAL_IIR_FIFO64  (1 << 5)
+
+// enables the FIFOs and returns how many bytes the transmitter can be handed at once
+static size_t serial_fifo_detect(device dev)
+{
+    outb(dev + LCR, 0x83); // divisor latch set, so the 64 byte FIFO bit is accepted
+    outb(dev + FCR, SERIAL_FCR_ENABLE | SERIAL_FCR_FIFO64);
+    outb(dev + LCR, 0x03);
+    unsigned char iir = inb(dev + IIR);
+    if ((iir & SERIAL_IIR_FIFO_OK) != SERIAL_IIR_FIFO_OK)
+    {
+        // 8250, 16450 or the 16550 with its broken FIFO, write a byte at a time
+        outb(dev + FCR, 0x00);
+        return 1;
+    }
+    return (iir & SERIAL_IIR_FIFO64) ? 64 : 16;
+}
+
+// bytes the receive FIFO triggers at, by the trigger bits and the size of the FIFO
+static size_t serial_rx_trigger(size_t fifo_sz)
+{
+    static const unsigned char levels_fifo16[] = { 1, 4, 8, 14 };
+    static const unsigned char levels_fifo64[] = { 1, 16, 32, 56 };
+    if (fifo_sz == 1)
+    {
+        // every byte interrupts without a FIFO
+        return 1;
+    }
+    const unsigned char* levels = (fifo_sz == 64) ? levels_fifo64 : levels_fifo16;
+    return levels[SERIAL_FCR_RX_TRIGGER >> 6];
+}
+
 #define SERIAL_IRQ_COM_2_4 (3)
 #define SERIAL_IRQ_COM_1_3 (4)
 
@@ -245,7 +320,8 @@ int serial_open(device dev, int speed)
     serial_dcb_list[dno].rbuffer_idx_begin = 0;
     serial_dcb_list[dno].rbuffer_idx_end = 0;
     serial_dcb_list[dno].open = 1;
-    serial_dcb_list[dno].event = 0;
+    serial_dcb_list[dno].rx_queue.event = 0;
+    serial_dcb_list[dno].tx_queue.event = 0;
 
     switch (dev)
     {
@@ -288,7 +364,13 @@ int serial_open(device dev, int speed)
 	outb(dev + DLL, (char)(brd));	    //set brd least significant byte
 	outb(dev + DLM, (char)(brd >> 8));	//set brd most significant byte
 	outb(dev + LCR, 0x03);	//lock divisor; 8bits, no parity, one stop
-	outb(dev + FCR, 0xC7);	//enable fifo, clear, 14byte threshold
+	serial_dcb_list[dno].tx_fifo_sz = serial_fifo_detect(dev);
+	serial_dcb_list[dno].rx_trigger = serial_rx_trigger(serial_dcb_list[dno].tx_fifo_sz);
+	serial_dcb_list[dno].tx_irqs = 0;
+	serial_dcb_list[dno].tx_bytes = 0;
+	serial_dcb_list[dno].rx_irqs = 0;
+	serial_dcb_list[dno].rx_bytes = 0;
+	serial_dcb_list[dno].rx_overruns = 0;
     cli();
     int mask = inb(PIC_1_MASK);
     switch (dev)
@@ -306,7 +388,7 @@ int serial_open(device dev, int speed)
     }
     outb(PIC_1_MASK, mask);
     outb(dev + MCR, (1 << 3));	// only enable device interrupts, set no rts/dsr
-    outb(dev + IER, (1 << 0)); // only enable serial input data received interrupts
+    outb(dev + IER, (1 << 0) | (1 << 2)); // enable input data received and line status interrupts
 	inb(dev); // read byte to reset port
     sti();
 	return 0;
@@ -324,7 +406,7 @@ int serial_close(device dev)
         return SERIAL_C_ERR_PORT_NOT_OPEN;
     }
     // ensure that there are no operations currently executing on the device
-    if (serial_dcb_list[dno].iocb_queue_head != NULL)
+    if ((serial_dcb_list[dno].rx_queue.head != NULL) || (serial_dcb_list[dno].tx_queue.head != NULL))
     {
         return SERIAL_C_ERR_DEV_BUSY;
     }
@@ -391,6 +473,83 @@ int serial_close(device dev)
     return 0;
 }
 
+// starts the READ at the head of the receive queue with any input buffered while
+// no READ was pending, completing it right away if that input suffices
+static void serial_rx_start(struct dcb* dcb)
+{
+    struct iocb* iocb_rq = dcb->rx_queue.head;
+    size_t buf_idx = 0;
+    dcb->rx_queue.event = 0;
+    while ((dcb->rbuffer_idx_begin != dcb->rbuffer_idx_end) && (buf_idx < iocb_rq->buffer_sz))
+    {
+        unsigned char byte = dcb->rbuffer[dcb->rbuffer_idx_begin];
+        iocb_rq->buffer[buf_idx++] = byte;
+        // loop the ring buffer 'begin' index if needed
+        if (++dcb->rbuffer_idx_begin == dcb->rbuffer_sz)
+        {
+            dcb->rbuffer_idx_begin = 0;
+        }
+        if (byte == '\r')
+        {
+            dcb->rx_queue.event = 1;
+            break;
+        }
+    }
+    if (buf_idx == iocb_rq->buffer_sz)
+    {
+        dcb->rx_queue.event = 1;
+    }
+    dcb->rx_queue.buffer_idx = buf_idx;
+}
+
+// hands the transmitter as much of the head WRITE as its FIFO holds, once the FIFO
+// is empty. polled output from serial_out() may still be in it
+static void serial_tx_fill(struct dcb* dcb)
+{
+    while (!(serial_line_status(dcb) & SERIAL_LSR_THR_EMPTY))
+    {
+    }
+    struct iocb* iocb_rq = dcb->tx_queue.head;
+    size_t burst = iocb_rq->buffer_sz - dcb->tx_queue.buffer_idx;
+    if (burst > dcb->tx_fifo_sz)
+    {
+        burst = dcb->tx_fifo_sz;
+    }
+    for (size_t i = 0; i < burst; ++i)
+    {
+        outb(dcb->dev + THR, iocb_rq->buffer[dcb->tx_queue.buffer_idx++]);
+    }
+    dcb->tx_bytes += burst;
+}
+
+// starts the WRITE at the head of the transmit queue
+static void serial_tx_start(struct dcb* dcb)
+{
+    dcb->tx_queue.buffer_idx = 0;
+    dcb->tx_queue.event = 0;
+    serial_tx_fill(dcb);
+    int ier = inb(dcb->dev + IER);
+    outb(dcb->dev + IER, (ier | (1 << 1)));
+}
+
+// sets up an operation as the only one of an idle queue
+static int serial_queue_start(struct iocb_queue* queue, char* buf, size_t len, unsigned char io_op)
+{
+    struct iocb* iocb_new = (struct iocb*) slab_alloc(&iocb_cache);
+    if (iocb_new == NULL)
+    {
+        return -1;
+    }
+    queue->head = iocb_new;
+    queue->tail = iocb_new;
+    iocb_new->p_next = NULL;
+    iocb_new->pcb_rq = pcb_running;
+    iocb_new->buffer = (unsigned char*) buf;
+    iocb_new->buffer_sz = len;
+    iocb_new->io_op = io_op;
+    return 0;
+}
+
 int serial_read(device dev, char* buf, size_t len)
 {
     if (buf == NULL)
@@ -411,50 +570,16 @@ int serial_read(device dev, char* buf, size_t len)
     {
         return SERIAL_R_ERR_PORT_NOT_OPEN;
     }
-    if (dcb_select->iocb_queue_head != NULL)
+    // only pending reads make a read wait, writes proceed independently
+    if (dcb_select->rx_queue.head != NULL)
     {
         return SERIAL_R_ERR_DEV_BUSY;
     }
-    // set up operation
-    struct iocb* iocb_new = (struct iocb*) sys_alloc_mem(sizeof(struct iocb));
-    if (iocb_new == NULL)
+    if (serial_queue_start(&dcb_select->rx_queue, buf, len, IO_OP_READ) != 0)
     {
         return SERIAL_R_ERR_OUT_OF_MEM;
     }
-    dcb_select->iocb_queue_head = iocb_new;
-    dcb_select->iocb_queue_tail = iocb_new;
-    iocb_new->p_next = NULL;
-    iocb_new->pcb_rq = pcb_running;
-    iocb_new->buffer = (unsigned char*) buf;
-    iocb_new->buffer_sz = len;
-    iocb_new->io_op = IO_OP_READ;
-    // start operation
-    size_t buf_idx = 0;
-    while ((dcb_select->rbuffer_idx_begin < dcb_select->rbuffer_idx_end)
-           && (buf_idx < len))
-    {
-        buf[buf_idx] = dcb_select->rbuffer[dcb_select->rbuffer_idx_begin];
-        ++dcb_select->rbuffer_idx_begin;
-        // loop the ring buffer 'begin' index if needed
-        if (dcb_select->rbuffer_idx_begin == dcb_select->rbuffer_sz)
-        {
-            dcb_select->rbuffer_idx_begin = 0;
-        }
-        if (buf[buf_idx] == '\r')
-        {
-            ++buf_idx;
-            goto read_complete;
-        }
-        ++buf_idx;
-    }
-    if (buf_idx < len)
-    {
-        dcb_select->buffer_idx = buf_idx;
-        return 0;
-    }
-    // buf_idx == len will cause fallthrough to here, as it indicates completion
-    read_complete: ;
-    dcb_select->buffer_idx = buf_idx;
+    serial_rx_start(dcb_select);
     return 0;
 }
 
@@ -478,129 +603,83 @@ int serial_write(device dev, char* buf, size_t len)
     {
         return SERIAL_W_ERR_PORT_NOT_OPEN;
     }
-    if (dcb_select->iocb_queue_head != NULL)
+    // only pending writes make a write wait, reads proceed independently
+    if (dcb_select->tx_queue.head != NULL)
     {
         return SERIAL_W_ERR_DEV_BUSY;
     }
-    // set up operation
-    struct iocb* iocb_new = (struct iocb*) sys_alloc_mem(sizeof(struct iocb));
-    if (iocb_new == NULL)
+    if (serial_queue_start(&dcb_select->tx_queue, buf, len, IO_OP_WRITE) != 0)
     {
         return SERIAL_W_ERR_OUT_OF_MEM;
     }
-    dcb_select->iocb_queue_head = iocb_new;
-    dcb_select->iocb_queue_tail = iocb_new;
-    iocb_new->p_next = NULL;
-    iocb_new->pcb_rq = pcb_running;
-    iocb_new->buffer = (unsigned char*) buf;
-    iocb_new->buffer_sz = len;
-    iocb_new->io_op = IO_OP_WRITE;
-    // start operation
-    dcb_select->buffer_idx = 0;
-    unsigned char next_byte = buf[0];
-    outb(dcb_select->dev, next_byte);
-    int ier = inb(dev + IER);
-    outb(dev + IER, (ier | (1 << 1)));
+    serial_tx_start(dcb_select);
     return 0;
 }
 
-int serial_check_io(device dev)
+// readies the process whose operation completed at the head of a queue, then
+// moves on to the queue's next operation. returns 1 if a process was readied
+static int serial_queue_complete(struct dcb* dcb, struct iocb_queue* queue)
 {
-    int dno = serial_devno(dev);
-    if (dno == -1)
+    if ((queue->head == NULL) || !queue->event)
     {
-        return -1;
+        return 0;
     }
-    struct dcb* dcb_select = &serial_dcb_list[dno];
-    if (!dcb_select->open)
+    // alias
+    struct iocb* iocb_done = queue->head;
+    struct pcb* pcb_hasevent = iocb_done->pcb_rq;
+    pcb_remove(pcb_hasevent);
+
+    pcb_set_exec(pcb_hasevent, PCB_EXEC_READY);
+    pcb_hasevent->pctxt->eax = queue->buffer_idx;
+    if (iocb_done->io_op == IO_OP_READ)
     {
-        return 0;
+        pcb_hasevent->acct.bytes_read += queue->buffer_idx;
     }
-    if (dcb_select->event)
+    else
     {
-        // queue a pcb if it has an event ready
-        // alias
-        struct pcb* pcb_hasevent = dcb_select->iocb_queue_head->pcb_rq;
-        pcb_remove(pcb_hasevent);
-
-        pcb_hasevent->state.exec = PCB_EXEC_READY;
-        pcb_hasevent->pctxt->eax = dcb_select->buffer_idx;
+        pcb_hasevent->acct.bytes_written += queue->buffer_idx;
+    }
 
-        pcb_insert(pcb_hasevent);
-        dcb_select->event = 0;
+    pcb_insert(pcb_hasevent);
+    queue->event = 0;
 
-        // free iocb from active operation and proceed to the next, if any
-        struct iocb* iocb_next = dcb_select->iocb_queue_head->p_next;
-        unsigned char io_op_prev = dcb_select->iocb_queue_head->io_op;
-        sys_free_mem(dcb_select->iocb_queue_head);
-        // only one operation in the list
-        if (dcb_select->iocb_queue_head == dcb_select->iocb_queue_tail)
+    // free iocb from active operation and proceed to the next, if any
+    queue->head = iocb_done->p_next;
+    if (queue->head == NULL)
+    {
+        queue->tail = NULL;
+    }
+    slab_free(&iocb_cache, iocb_done);
+    if (queue->head != NULL)
+    {
+        if (queue == &dcb->rx_queue)
         {
-            dcb_select->iocb_queue_tail = iocb_next;
+            serial_rx_start(dcb);
         }
-        dcb_select->iocb_queue_head = iocb_next;
-        // if there is a next operation, configure accordingly
-        if (iocb_next != NULL)
+        else
         {
-            // deconfigure from previous operation
-            if (iocb_next->io_op != io_op_prev)
-            {
-                switch (io_op_prev)
-                {
-                case IO_OP_WRITE:
-                {
-                    int ier = inb(dev + IER);
-                    outb(dev + IER, (ier & ~(1 << 1)));
-                    break;
-                }
-                }
-            }
-            // proceed to initial steps in next operation
-            switch (iocb_next->io_op)
-            {
-            case IO_OP_READ:
-            {
-                size_t buf_idx = 0;
-                while ((dcb_select->rbuffer_idx_begin < dcb_select->rbuffer_idx_end)
-                       && (buf_idx < iocb_next->buffer_sz))
-                {
-                    iocb_next->buffer[buf_idx] = dcb_select->rbuffer[dcb_select->rbuffer_idx_begin];
-                    ++dcb_select->rbuffer_idx_begin;
-                    // loop the ring buffer 'begin' index if needed
-                    if (dcb_select->rbuffer_idx_begin == dcb_select->rbuffer_sz)
-                    {
-                        dcb_select->rbuffer_idx_begin = 0;
-                    }
-                    if (iocb_next->buffer[buf_idx] == '\r')
-                    {
-                        ++buf_idx;
-                        goto read_complete;
-                    }
-                    ++buf_idx;
-                }
-                if (buf_idx < iocb_next->buffer_sz)
-                {
-                    dcb_select->buffer_idx = buf_idx;
-                    break;
-                }
-                // buf_idx == len will cause fallthrough to here, as it indicates completion
-                read_complete: ;
-                dcb_select->buffer_idx = buf_idx;
-                break;
-            }
-            case IO_OP_WRITE:
-            {
-                dcb_select->buffer_idx = 0;
-                outb(serial_dcb_list[dno].dev, iocb_next->buffer[0]);
-                int ier = inb(dev + IER);
-                outb(dev + IER, (ier | (1 << 1)));
-                break;
-            }
-            }
+            serial_tx_start(dcb);
         }
-        return 1;
     }
-    return 0;
+    return 1;
+}
+
+int serial_check_io(device dev)
+{
+    int dno = serial_devno(dev);
+    if (dno == -1)
+    {
+        return -1;
+    }
+    struct dcb* dcb_select = &serial_dcb_list[dno];
+    if (!dcb_select->open)
+    {
+        return 0;
+    }
+    // both directions can complete in the same check
+    int rx_ready = serial_queue_complete(dcb_select, &dcb_select->rx_queue);
+    int tx_ready = serial_queue_complete(dcb_select, &dcb_select->tx_queue);
+    return rx_ready || tx_ready;
 }
 
 int serial_schedule_io(device dev, unsigned char* buffer, size_t buffer_sz,
@@ -624,56 +703,31 @@ int serial_schedule_io(device dev, unsigned char* buffer, size_t buffer_sz,
     {
         return SERIAL_S_ERR_PORT_NOT_OPEN;
     }
-    // check for no queued operations (device is idle)
-    if (dcb_select->iocb_queue_head == NULL)
+    struct iocb_queue* queue = (io_op == IO_OP_READ) ? &dcb_select->rx_queue : &dcb_select->tx_queue;
+    // check for no queued operations in the requested direction
+    if (queue->head == NULL)
     {
-        int ret;
-        switch (io_op)
+        int ret = (io_op == IO_OP_READ)
+            ? serial_read(dev, (char*)buffer, buffer_sz)
+            : serial_write(dev, (char*)buffer, buffer_sz);
+        switch (ret)
         {
-        case IO_OP_READ:
+        case SERIAL_R_ERR_DEV_BUSY:
+        case SERIAL_W_ERR_DEV_BUSY:
         {
-            ret = serial_read(dev, (char*)buffer, buffer_sz);
-            if (ret != 0)
-            {
-                switch (ret)
-                {
-                case SERIAL_R_ERR_DEV_BUSY:
-                {
-                    return SERIAL_S_ERR_DEV_BUSY;
-                }
-                case SERIAL_R_ERR_OUT_OF_MEM:
-                {
-                    return SERIAL_S_ERR_OUT_OF_MEM;
-                }
-                }
-            }
-            break;
+            return SERIAL_S_ERR_DEV_BUSY;
         }
-        case IO_OP_WRITE:
+        case SERIAL_R_ERR_OUT_OF_MEM:
+        case SERIAL_W_ERR_OUT_OF_MEM:
         {
-            int ret = serial_write(dev, (char*)buffer, buffer_sz);
-            if (ret != 0)
-            {
-                switch (ret)
-                {
-                case SERIAL_W_ERR_DEV_BUSY:
-                {
-                    return SERIAL_S_ERR_DEV_BUSY;
-                }
-                case SERIAL_W_ERR_OUT_OF_MEM:
-                {
-                    return SERIAL_S_ERR_OUT_OF_MEM;
-                }
-                }
-            }
-            break;
+            return SERIAL_S_ERR_OUT_OF_MEM;
         }
         }
     }
-    else // selected device is not idle
+    else // the requested direction is not idle
     {
-        // queue an I/O operation on the selected device
-        struct iocb* iocb_new = (struct iocb*) sys_alloc_mem(sizeof(struct iocb));
+        // queue an I/O operation behind the ones of the same direction
+        struct iocb* iocb_new = (struct iocb*) slab_alloc(&iocb_cache);
         if (iocb_new == NULL)
         {
             return SERIAL_S_ERR_OUT_OF_MEM;
@@ -684,44 +738,51 @@ int serial_schedule_io(device dev, unsigned char* buffer, size_t buffer_sz,
         iocb_new->buffer_sz = buffer_sz;
         iocb_new->io_op = io_op;
 
-        dcb_select->iocb_queue_tail->p_next = iocb_new;
-        dcb_select->iocb_queue_tail = iocb_new;
+        queue->tail->p_next = iocb_new;
+        queue->tail = iocb_new;
     }
     return 0;
 }
 
 void serial_input_interrupt(struct dcb* dcb)
 {
-    unsigned char byte = inb(dcb->dev);
-    if (dcb->iocb_queue_head->io_op != IO_OP_READ)
+    ++dcb->rx_irqs;
+    // empty the receive FIFO, not just the byte that reached the trigger
+    while (serial_line_status(dcb) & SERIAL_LSR_DATA_READY)
     {
-        // store input byte in ring buffer for next READ request to initially copy
-        dcb->rbuffer[dcb->rbuffer_idx_end] = byte;
-        // shift ring buffer begin index if at capacity (having wrote on top of beginning index)
-        if (dcb->rbuffer_idx_end == dcb->rbuffer_idx_begin)
+        unsigned char byte = inb(dcb->dev);
+        ++dcb->rx_bytes;
+        if ((dcb->rx_queue.head == NULL) || dcb->rx_queue.event)
         {
-            ++dcb->rbuffer_idx_begin;
-            if (dcb->rbuffer_idx_begin == dcb->rbuffer_sz)
+            // store input byte in ring buffer for next READ request to initially copy
+            size_t end_next = dcb->rbuffer_idx_end + 1;
+            if (end_next == dcb->rbuffer_sz)
             {
-                dcb->rbuffer_idx_begin = 0;
+                end_next = 0;
             }
+            // drop the oldest byte if at capacity
+            if (end_next == dcb->rbuffer_idx_begin)
+            {
+                ++dcb->rbuffer_idx_begin;
+                if (dcb->rbuffer_idx_begin == dcb->rbuffer_sz)
+                {
+                    dcb->rbuffer_idx_begin = 0;
+                }
+            }
+            dcb->rbuffer[dcb->rbuffer_idx_end] = byte;
+            dcb->rbuffer_idx_end = end_next;
         }
-        ++dcb->rbuffer_idx_end;
-        if (dcb->rbuffer_idx_end == dcb->rbuffer_sz)
+        else
         {
-            dcb->rbuffer_idx_end = 0;
-        }
-    }
-    else if (!dcb->event)
-    {
-        // alias
-        struct iocb* iocb_rq = dcb->iocb_queue_head;
+            // alias
+            struct iocb* iocb_rq = dcb->rx_queue.head;
 
-        iocb_rq->buffer[dcb->buffer_idx] = byte;
-        ++dcb->buffer_idx;
-        if ((dcb->buffer_idx == iocb_rq->buffer_sz) || (byte == '\r'))
-        {
-            dcb->event = 1;
+            iocb_rq->buffer[dcb->rx_queue.buffer_idx] = byte;
+            ++dcb->rx_queue.buffer_idx;
+            if ((dcb->rx_queue.buffer_idx == iocb_rq->buffer_sz) || (byte == '\r'))
+            {
+                dcb->rx_queue.event = 1;
+            }
         }
     }
     return;
@@ -729,114 +790,96 @@ void serial_input_interrupt(struct dcb* dcb)
 
 void serial_output_interrupt(struct dcb* dcb)
 {
-    if (!dcb->event)
+    if ((dcb->tx_queue.head != NULL) && !dcb->tx_queue.event)
     {
-        if (dcb->iocb_queue_head->io_op == IO_OP_WRITE)
-        {
-            // alias
-            struct iocb* iocb_rq = dcb->iocb_queue_head;
-            // interrupt confirms byte was sent, so increment here
-            ++dcb->buffer_idx;
+        // interrupt confirms the FIFO emptied, so every byte handed over was sent
+        ++dcb->tx_irqs;
 
-            // check for write completion
-            if (dcb->buffer_idx == iocb_rq->buffer_sz)
-            {
-                dcb->event = 1;
-                // clear write-out interrupts
-                unsigned char ier = inb(dcb->dev + IER);
-                outb(dcb->dev + IER, ier & ~(1 << 1));
-            }
-            else // writing is still not done
-            {
-                unsigned char next_byte = iocb_rq->buffer[dcb->buffer_idx];
-                outb(dcb->dev, next_byte);
-            }
+        // check for write completion
+        if (dcb->tx_queue.buffer_idx == dcb->tx_queue.head->buffer_sz)
+        {
+            dcb->tx_queue.event = 1;
+            // clear write-out interrupts
+            unsigned char ier = inb(dcb->dev + IER);
+            outb(dcb->dev + IER, ier & ~(1 << 1));
+        }
+        else // writing is still not done, refill the FIFO
+        {
+            serial_tx_fill(dcb);
         }
     }
     return;
 }
 
-void serial_interrupt(void)
+// services every cause the device has pending, until its IIR reads back idle
+static void serial_device_interrupt(struct dcb* dcb)
 {
-    // get IRQ to identify serial device(s)
-    // command to read ISR
-    outb(PIC_1_CMD, PIC_READ_ISR);
-    unsigned char irq = inb(PIC_1_CMD);
-    struct dcb* dcb_select;
-    unsigned char serial_iir;
-    switch (irq)
+    // an unopened device has its interrupts disabled, ignore it
+    if (!dcb->open)
     {
-    // select specific device via bit 0 of IIR in associated serial devices 
-    // COM2 or COM4
-    case IRQ_BIT(SERIAL_IRQ_COM_2_4):
+        return;
+    }
+    unsigned char serial_iir;
+    // bit 0 of IIR is clear while an interrupt is pending
+    while (((serial_iir = inb(dcb->dev + IIR)) & 0x01) == 0)
     {
-        // check for COM2 interrupt
-        serial_iir = inb(COM2 + IIR);
-        if ((serial_iir & 0x01) == 0)
+        // check interrupt type for the device and execute second-level handlers
+        switch (serial_iir & 0x0E)
         {
-            dcb_select = &serial_dcb_list[serial_devno(COM2)];
+        case (0 << 1): // Modem Status
+        {
+            inb(dcb->dev + MSR);
             break;
         }
-        else // COM4 interrupt
+        case (1 << 1): // Output
         {
-            serial_iir = inb(COM4 + IIR);
-            dcb_select = &serial_dcb_list[serial_devno(COM4)];
+            serial_output_interrupt(dcb);
+            break;
         }
-        break;
-    }
-    // COM1 or COM3
-    case IRQ_BIT(SERIAL_IRQ_COM_1_3):
-    {
-        // check for COM1 interrupt
-        serial_iir = inb(COM1 + IIR);
-        if ((serial_iir & 0x01) == 0)
+        case (2 << 1): // Input
+        case (6 << 1): // Input character timeout, fewer bytes than the trigger are waiting
         {
-            dcb_select = &serial_dcb_list[serial_devno(COM1)];
+            serial_input_interrupt(dcb);
             break;
         }
-        else // COM3 interrupt
+        case (3 << 1): // Line Status
         {
-            serial_iir = inb(COM3 + IIR);
-            dcb_select = &serial_dcb_list[serial_devno(COM3)];
+            serial_line_status(dcb);
+            break;
+        }
+        default: // not a cause a 16550 reports, stop rather than spin
+        {
+            return;
+        }
         }
-        break;
-    }
-    }
-
-    // check that selected device is open, if not, ignore interrupt and return
-    if (!dcb_select->open)
-    {
-        goto handler_exit;
     }
+}
 
-    // check interrupt type for the device and execute second-level handlers
-    switch (serial_iir & 0x06)
-    {
-    case (0 << 1): // Modem Status
-    {
-        inb(dcb_select->dev + MSR);
-        break;
-    }
-    case (1 << 1): // Output
+void serial_interrupt(void)
+{
+    // get IRQ to identify serial device(s)
+    // command to read ISR
+    outb(PIC_1_CMD, PIC_READ_ISR);
+    unsigned char irq = inb(PIC_1_CMD);
+    // both devices sharing the IRQ may have raised it, so service each of them
+    switch (irq)
     {
-        serial_output_interrupt(dcb_select);
-        break;
-    }
-    case (2 << 1): // Input
+    // COM2 or COM4
+    case IRQ_BIT(SERIAL_IRQ_COM_2_4):
     {
-        serial_input_interrupt(dcb_select);
+        serial_device_interrupt(&serial_dcb_list[serial_devno(COM2)]);
+        serial_device_interrupt(&serial_dcb_list[serial_devno(COM4)]);
         break;
     }
-    case (3 << 1): // Line Status
+    // COM1 or COM3
+    case IRQ_BIT(SERIAL_IRQ_COM_1_3):
     {
-        // simply read and discard
-        inb(dcb_select->dev + LSR);
+        serial_device_interrupt(&serial_dcb_list[serial_devno(COM1)]);
+        serial_device_interrupt(&serial_dcb_list[serial_devno(COM3)]);
         break;
     }
     }
-    
-    handler_exit: ;
+
     outb(PIC_1_CMD, PIC_EOI);
     return;
 }
-
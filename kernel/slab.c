@@ -0,0 +1,220 @@
+#include <mpx/slab.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mpx/memory.h>
+#include <mpx/timer.h>
+
+
+// a slab holds at least this many objects, and more while it stays within SLAB_TARGET_SZ
+#define SLAB_OBJS_MIN  (4)
+#define SLAB_TARGET_SZ (2048)
+
+/*
+  Slab header, followed by the slab's slots. Each slot is a pointer back to the
+  slab, so a freed object finds its slab in constant time, followed by the object.
+*/
+struct slab {
+    struct slab* p_next;
+    struct slab* p_prev;
+    void* free_objs; // free objects, linked through their first word
+    size_t objs;
+    size_t in_use;
+};
+
+#define SLAB_ROUND_UP(size) (((size) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+
+static struct slab_cache* slab_caches = NULL;
+
+static inline size_t slab_stride(const struct slab_cache* cache)
+{
+    size_t obj_size = SLAB_ROUND_UP(cache->obj_size);
+    if (obj_size < sizeof(void*))
+    {
+        obj_size = sizeof(void*);
+    }
+    return sizeof(struct slab*) + obj_size;
+}
+
+static inline size_t slab_objs(const struct slab_cache* cache)
+{
+    size_t objs = (SLAB_TARGET_SZ - sizeof(struct slab)) / slab_stride(cache);
+    return (objs < SLAB_OBJS_MIN) ? SLAB_OBJS_MIN : objs;
+}
+
+static inline void* slab_obj(struct slab* slab, size_t stride, size_t i)
+{
+    return (unsigned char*)(slab + 1) + i * stride + sizeof(struct slab*);
+}
+
+static void slab_list_insert(struct slab** head, struct slab* slab)
+{
+    slab->p_prev = NULL;
+    slab->p_next = *head;
+    if (*head != NULL)
+    {
+        (*head)->p_prev = slab;
+    }
+    *head = slab;
+}
+
+static void slab_list_remove(struct slab** head, struct slab* slab)
+{
+    if (slab->p_prev != NULL)
+    {
+        slab->p_prev->p_next = slab->p_next;
+    }
+    else
+    {
+        *head = slab->p_next;
+    }
+    if (slab->p_next != NULL)
+    {
+        slab->p_next->p_prev = slab->p_prev;
+    }
+}
+
+// creates a slab of constructed objects and files it as partial
+static struct slab* slab_create(struct slab_cache* cache)
+{
+    size_t stride = slab_stride(cache);
+    size_t objs = slab_objs(cache);
+    struct slab* slab = allocate_memory(sizeof(struct slab) + objs * stride);
+    if (slab == NULL)
+    {
+        return NULL;
+    }
+    slab->free_objs = NULL;
+    slab->objs = objs;
+    slab->in_use = 0;
+    for (size_t i = objs; i > 0; --i)
+    {
+        void* obj = slab_obj(slab, stride, i - 1);
+        ((struct slab**)obj)[-1] = slab;
+        if ((cache->ctor != NULL) && (cache->ctor(obj) != 0))
+        {
+            // undo the objects constructed so far
+            for (size_t j = i; j < objs; ++j)
+            {
+                if (cache->dtor != NULL)
+                {
+                    cache->dtor(slab_obj(slab, stride, j));
+                }
+            }
+            free_memory(slab);
+            return NULL;
+        }
+    }
+    // link the free objects only once constructors, which may use the first word, have run
+    for (size_t i = objs; i > 0; --i)
+    {
+        void* obj = slab_obj(slab, stride, i - 1);
+        *(void**)obj = slab->free_objs;
+        slab->free_objs = obj;
+    }
+    if ((cache->stat_slabs == 0) && (cache->stat_allocs == 0))
+    {
+        // first use of the cache, list it for statistics
+        struct slab_cache* iter = slab_caches;
+        while ((iter != NULL) && (iter != cache))
+        {
+            iter = iter->p_next;
+        }
+        if (iter == NULL)
+        {
+            cache->p_next = slab_caches;
+            slab_caches = cache;
+        }
+    }
+    slab_list_insert(&cache->slabs_partial, slab);
+    ++cache->stat_slabs;
+    cache->stat_objs += objs;
+    return slab;
+}
+
+static void slab_destroy(struct slab_cache* cache, struct slab* slab)
+{
+    size_t stride = slab_stride(cache);
+    slab_list_remove(&cache->slabs_partial, slab);
+    --cache->stat_slabs;
+    cache->stat_objs -= slab->objs;
+    if (cache->dtor != NULL)
+    {
+        for (size_t i = 0; i < slab->objs; ++i)
+        {
+            cache->dtor(slab_obj(slab, stride, i));
+        }
+    }
+    free_memory(slab);
+}
+
+// caches are shared by all processes, so keep the timer from switching away mid-operation
+void* slab_alloc(struct slab_cache* cache)
+{
+    preempt_disable();
+    struct slab* slab = cache->slabs_partial;
+    if (slab == NULL)
+    {
+        slab = slab_create(cache);
+        if (slab == NULL)
+        {
+            ++cache->stat_fails;
+            preempt_enable();
+            return NULL;
+        }
+    }
+    void* obj = slab->free_objs;
+    slab->free_objs = *(void**)obj;
+    ++slab->in_use;
+    if (slab->free_objs == NULL)
+    {
+        slab_list_remove(&cache->slabs_partial, slab);
+        slab_list_insert(&cache->slabs_full, slab);
+    }
+    ++cache->stat_allocs;
+    ++cache->stat_in_use;
+    preempt_enable();
+    return obj;
+}
+
+void slab_free(struct slab_cache* cache, void* obj)
+{
+    preempt_disable();
+    struct slab* slab = ((struct slab**)obj)[-1];
+    if (slab->free_objs == NULL)
+    {
+        slab_list_remove(&cache->slabs_full, slab);
+        slab_list_insert(&cache->slabs_partial, slab);
+    }
+    *(void**)obj = slab->free_objs;
+    slab->free_objs = obj;
+    --slab->in_use;
+    ++cache->stat_frees;
+    --cache->stat_in_use;
+    if ((slab->in_use == 0) && (cache->stat_objs - slab->objs >= cache->objs_min))
+    {
+        slab_destroy(cache, slab);
+    }
+    preempt_enable();
+}
+
+int slab_reserve(struct slab_cache* cache, size_t count)
+{
+    preempt_disable();
+    cache->objs_min = count;
+    while (cache->stat_objs < count)
+    {
+        if (slab_create(cache) == NULL)
+        {
+            preempt_enable();
+            return -1;
+        }
+    }
+    preempt_enable();
+    return 0;
+}
+
+struct slab_cache* slab_cache_first(void)
+{
+    return slab_caches;
+}
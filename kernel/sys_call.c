@@ -8,11 +8,72 @@
 #include <mpx/serial.h>
 #include <mpx/device.h>
 #include <mpx/interrupts.h>
+#include <mpx/timer.h>
+#include <mpx/tsc.h>
+#include <string.h>
 
 
+#define MSR_SYSENTER_CS  (0x174)
+#define MSR_SYSENTER_ESP (0x175)
+#define MSR_SYSENTER_EIP (0x176)
+#define CPUID_EDX_SEP    (1 << 11)
+#define KERNEL_CS        (0x08)
+
+extern void sysenter_entry(void);
+
+_Static_assert(MPX_PCB_ACCT_OPS == SLEEP_UNTIL + 1, "one syscall counter per op_code");
+
 void* context_original = NULL;
+unsigned char sys_call_fast = 0;
+
+// SYSENTER loads its stack pointer from an MSR, only used until the entry stub
+// moves back onto the caller's stack
+static unsigned char sysenter_stack[256] __attribute__((aligned(16)));
+
+static inline void wrmsr(uint32_t msr, uint32_t value)
+{
+    __asm__ volatile ("wrmsr" :: "c"(msr), "a"(value), "d"(0));
+}
+
+int sys_call_fast_init(void)
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+    __asm__ volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    uint32_t family = (eax >> 8) & 0xF;
+    uint32_t model = (eax >> 4) & 0xF;
+    uint32_t stepping = eax & 0xF;
+    // early Pentium Pro parts report SEP without implementing SYSENTER
+    if (!(edx & CPUID_EDX_SEP) || (family == 6 && model < 3 && stepping < 3))
+    {
+        return -1;
+    }
+    wrmsr(MSR_SYSENTER_CS, KERNEL_CS);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t)(sysenter_stack + sizeof(sysenter_stack)));
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+    sys_call_fast = 1;
+    return 0;
+}
+
+uint32_t sys_call_null_cycles(unsigned char fast, unsigned int iterations)
+{
+    unsigned char fast_saved = sys_call_fast;
+    uint32_t start, end;
+    if (iterations == 0)
+    {
+        return 0;
+    }
+    sys_call_fast = fast;
+    start = (uint32_t)rdtsc();
+    for (unsigned int i = 0; i < iterations; ++i)
+    {
+        sys_req(SYS_CALL_NULL_OP);
+    }
+    end = (uint32_t)rdtsc();
+    sys_call_fast = fast_saved;
+    return (end - start) / iterations;
+}
 
-unsigned char sys_check_io()
+unsigned char sys_check_io(void)
 {
     unsigned char procs_ready = 0;
     for (size_t i = 0; i < sizeof(serial_dcb_list) / sizeof(struct dcb); ++i)
@@ -25,6 +86,85 @@ unsigned char sys_check_io()
     return procs_ready;
 }
 
+#if MPX_EXIT_SUMMARY
+// writes the accounting of an exiting process to COM1 as a single line of key=value pairs
+static void sys_exit_summary(struct pcb* pcb)
+{
+    // static, as the exiting process' stack is small; sys_call() is never reentered
+    static char line[320];
+    char num[21];
+    size_t len = 0;
+    const size_t sz = sizeof(line);
+
+    pcb_acct_update(pcb);
+    len = strappend(line, len, sz, "exit name=");
+    len = strappend(line, len, sz, pcb->name);
+    len = strappend(line, len, sz, " pid=");
+    u64toa(num, pcb->pid);
+    len = strappend(line, len, sz, num);
+    len = strappend(line, len, sz, " dispatches=");
+    u64toa(num, pcb->acct.dispatches);
+    len = strappend(line, len, sz, num);
+    len = strappend(line, len, sz, " run_cycles=");
+    u64toa(num, pcb->acct.run_cycles);
+    len = strappend(line, len, sz, num);
+    len = strappend(line, len, sz, " ready_cycles=");
+    u64toa(num, pcb->acct.ready_cycles);
+    len = strappend(line, len, sz, num);
+    len = strappend(line, len, sz, " blocked_cycles=");
+    u64toa(num, pcb->acct.blocked_cycles);
+    len = strappend(line, len, sz, num);
+    // one count per op_code, in op_code order
+    len = strappend(line, len, sz, " syscalls=");
+    for (size_t i = 0; i < MPX_PCB_ACCT_OPS; ++i)
+    {
+        u64toa(num, pcb->acct.syscalls[i]);
+        len = strappend(line, len, sz, num);
+        len = strappend(line, len, sz, (i + 1 < MPX_PCB_ACCT_OPS) ? "," : "");
+    }
+    len = strappend(line, len, sz, " bytes_read=");
+    u64toa(num, pcb->acct.bytes_read);
+    len = strappend(line, len, sz, num);
+    len = strappend(line, len, sz, " bytes_written=");
+    u64toa(num, pcb->acct.bytes_written);
+    len = strappend(line, len, sz, num);
+    len = strappend(line, len, sz, "\r\n");
+    serial_out(COM1, line, len);
+}
+#endif
+
+// blocks the running process and dispatches the next ready one, waiting for one if there are none
+static struct context* sys_block_running(struct context* context_in)
+{
+    struct pcb* runnext;
+    pcb_set_exec(pcb_running, PCB_EXEC_BLOCKED);
+    // set the requesting process' stack pointer to the context to switch to after next run
+    pcb_running->pctxt = context_in;
+    // enqueue the requesting process into the active blocked queue
+    pcb_insert(pcb_running);
+    // dequeue the next active ready process
+    runnext = pcb_next_ready();
+    if (runnext == NULL)
+    {
+        // ready queue empty, so no more processes to execute
+        pcb_running = NULL;
+        // wait for interrupts to finish I/O or expire timers for any waiting processes
+        do
+        {
+            sti();
+            __asm__ volatile ("hlt");
+            cli();
+            sys_check_io();
+            runnext = pcb_next_ready();
+        }
+        while (runnext == NULL);
+    }
+    // set the running pcb to the dequeued one and return its context to switch to
+    pcb_running = runnext;
+    pcb_set_exec(runnext, PCB_EXEC_RUNNING);
+    return runnext->pctxt;
+}
+
 struct context* sys_call(struct context* context_in)
 {
     // get requested syscall operation
@@ -34,6 +174,13 @@ struct context* sys_call(struct context* context_in)
     size_t buffer_sz;
 
     sys_check_io();
+    // the last process to exit is no longer on its stack
+    pcb_reap();
+
+    if ((pcb_running != NULL) && (op >= 0) && (op < MPX_PCB_ACCT_OPS))
+    {
+        ++pcb_running->acct.syscalls[op];
+    }
 
     struct pcb* runnext;
     context_in->eax = 0;
@@ -55,38 +202,8 @@ struct context* sys_call(struct context* context_in)
                     // context_in->eax is 0
                     return (void*)0;
                 }
-                // block process after request
-                pcb_running->state.exec = PCB_EXEC_BLOCKED;
-                // set the requesting process' stack pointer to the context to switch to after next run
-                pcb_running->pctxt = context_in;
-                // enqueue the requesting process into the active blocked queue
-                pcb_insert(pcb_running);
-                if (pcb_queues[0].pcb_head != NULL)
-                {
-                    // dequeue the next active ready process
-                    runnext = pcb_queues[0].pcb_head;
-                    pcb_remove(runnext);
-                    // set the running pcb to the dequeued one and return its context to switch to
-                    pcb_running = runnext;
-                    runnext->state.exec = PCB_EXEC_RUNNING;
-                    return runnext->pctxt;
-                }
-                // ready queue empty, so no more processes to execute
-                pcb_running = NULL;
-                // wait for interrupts to finish operations for any waiting processes
-                do
-                {
-                    sti();
-                    __asm__ volatile ("hlt");
-                    cli();
-                }
-                while (!sys_check_io());
-                // guaranteed ready pcb at head
-                runnext = pcb_queues[0].pcb_head;
-                pcb_remove(runnext);
-                pcb_running = runnext;
-                runnext->state.exec = PCB_EXEC_RUNNING;
-                return runnext->pctxt;
+                // block process after request and switch to the next
+                return sys_block_running(context_in);
             }
             else
             {
@@ -107,38 +224,8 @@ struct context* sys_call(struct context* context_in)
                     // context_in->eax is 0
                     return (void*)0;
                 }
-                // block process after request
-                pcb_running->state.exec = PCB_EXEC_BLOCKED;
-                // set the requesting process' stack pointer to the context to switch to after next run
-                pcb_running->pctxt = context_in;
-                // enqueue the requesting process into the active blocked queue
-                pcb_insert(pcb_running);
-                if (pcb_queues[0].pcb_head != NULL)
-                {
-                    // dequeue the next active ready process
-                    runnext = pcb_queues[0].pcb_head;
-                    pcb_remove(runnext);
-                    // set the running pcb to the dequeued one and return its context to switch to
-                    pcb_running = runnext;
-                    runnext->state.exec = PCB_EXEC_RUNNING;
-                    return runnext->pctxt;
-                }
-                // ready queue empty, so no more processes to execute
-                pcb_running = NULL;
-                // wait for interrupts to finish operations for any waiting processes
-                do
-                {
-                    sti();
-                    __asm__ volatile ("hlt");
-                    cli();
-                }
-                while (!sys_check_io());
-                // guaranteed ready pcb at head
-                runnext = pcb_queues[0].pcb_head;
-                pcb_remove(runnext);
-                pcb_running = runnext;
-                runnext->state.exec = PCB_EXEC_RUNNING;
-                return runnext->pctxt;
+                // block process after request and switch to the next
+                return sys_block_running(context_in);
             }
             else
             {
@@ -159,26 +246,26 @@ struct context* sys_call(struct context* context_in)
             {
                 context_original = context_in;
             }
-            // check for any ready processes
-            if (pcb_queues[0].pcb_head != NULL)
+            // check for any ready processes, dequeueing the next active ready process
+            runnext = pcb_next_ready();
+            if (runnext != NULL)
             {
-                // dequeue the next active ready process
-                runnext = pcb_queues[0].pcb_head;
-                pcb_remove(runnext);
                 // enqueue the yielding process (if any) into the active ready queue (state unchanged)
                 if (pcb_running != NULL)
                 {
                     // set the yielding process' stack pointer to the context to switch to after next run
                     pcb_running->pctxt = context_in;
-                    pcb_running->state.exec = PCB_EXEC_READY;
+                    pcb_set_exec(pcb_running, PCB_EXEC_READY);
                     pcb_insert(pcb_running);
                 }
                 // set the running pcb to the dequeued one and return its context to switch to
                 pcb_running = runnext;
-                runnext->state.exec = PCB_EXEC_RUNNING;
+                pcb_set_exec(runnext, PCB_EXEC_RUNNING);
                 return runnext->pctxt;
             }
-            // no ready processes so just get back to the one that called
+            // no ready processes so the system is idle, use the time to zero a recycled stack
+            pcb_pool_scrub();
+            // then just get back to the one that called
             return (void*)0;
 
             /*
@@ -189,17 +276,48 @@ struct context* sys_call(struct context* context_in)
             return temp;
             */
         }
+        // ticks to sleep for (SLEEP) or tick to sleep until (SLEEP_UNTIL): context_in->ebx
+        case SLEEP:
+        case SLEEP_UNTIL:
+        {
+            if (pcb_running != NULL)
+            {
+                uint32_t deadline = (uint32_t)context_in->ebx;
+                if (op == SLEEP)
+                {
+                    deadline += timer_ticks;
+                }
+                // nothing to wait for if the deadline has already passed
+                if ((int32_t)(deadline - timer_ticks) <= 0)
+                {
+                    return (void*)0;
+                }
+                // park the process on the timer wheel until its deadline, then switch to the next
+                timer_sleep_until(pcb_running, deadline);
+                return sys_block_running(context_in);
+            }
+            else
+            {
+                context_in->eax = -1;
+                return (void*)0;
+            }
+        }
         case EXIT:
         {
+#if MPX_EXIT_SUMMARY
+            if (pcb_running != NULL)
+            {
+                sys_exit_summary(pcb_running);
+            }
+#endif
             pcb_free(pcb_running);
-            if (pcb_queues[0].pcb_head != NULL)
+            // dequeue the next active ready process
+            runnext = pcb_next_ready();
+            if (runnext != NULL)
             {
-                // dequeue the next active ready process
-                runnext = pcb_queues[0].pcb_head;
-                pcb_remove(pcb_queues[0].pcb_head);
                 // set the running pcb to the dequeued one and return its context to switch to
                 pcb_running = runnext;
-                runnext->state.exec = PCB_EXEC_RUNNING;
+                pcb_set_exec(runnext, PCB_EXEC_RUNNING);
                 return runnext->pctxt;
             }
             else if (context_original != NULL) // no dequeueable processes, load first arrived context
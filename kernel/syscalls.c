@@ -15,6 +15,10 @@ int idle() {
     return sys_req (IDLE);
 }
 
+int sleep(unsigned int ticks) {
+    return sys_req (SLEEP, ticks);
+}
+
 int exitret() {
     return sys_req (EXIT);
 }
@@ -188,32 +188,34 @@ void getDate() {
     return;
 }
 
-#include <memory.h>
+#include <mpx/timer.h>
+
+// reads the RTC time of day in seconds
+static int rtc_seconds_of_day(void) {
+    cli();
+    outb(0x70, 0x00); // access seconds
+    int seconds = BCDtoDecimal(inb(0x71));
+    outb(0x70, 0x02); // access minutes
+    int minutes = BCDtoDecimal(inb(0x71));
+    outb(0x70, 0x04); // access hours
+    int hours = BCDtoDecimal(inb(0x71));
+    sti();
+    return (hours * 60 + minutes) * 60 + seconds;
+}
 
 void alarmProcess(struct alarmProcessParams args) {
 	int timeToMatch = (args.hours * 60 + args.minutes) * 60 + args.seconds;
-	outb(0x70, 0x00); // access seconds
-	int second_now = BCDtoDecimal(inb(0x71));
-	outb(0x70, 0x02); // access minutes
-	int minute_now = BCDtoDecimal(inb(0x71));
-	outb(0x70, 0x04); // access hours
-	int hour_now = BCDtoDecimal(inb(0x71));
-	while ((hour_now * 60 + minute_now) * 60 + second_now < timeToMatch)
+	int time_now = rtc_seconds_of_day();
+	// block on the timer until the alarm time, re-checking the RTC on waking to absorb drift
+	while (time_now < timeToMatch)
     {
-        idle();
-        // poll for current time
-		outb(0x70, 0x00); // access seconds
-		second_now = BCDtoDecimal(inb(0x71));
-		outb(0x70, 0x02); // access minutes
-		minute_now = BCDtoDecimal(inb(0x71));
-		outb(0x70, 0x04); // access hours
-		hour_now = BCDtoDecimal(inb(0x71));
+        sleep((unsigned int)(timeToMatch - time_now) * TIMER_TICK_HZ);
+        time_now = rtc_seconds_of_day();
 	}
     setTerminalColor(Red);
     write(COM1, STR_BUF("[ALARM]: "));
 	write(COM1, args.msg, strlen(args.msg));
     write(COM1, STR_BUF("\r\n"));
-    sys_free_mem((void*) args.msg);
 	exitret();
 }
 
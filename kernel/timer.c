@@ -0,0 +1,263 @@
+#include <mpx/timer.h>
+
+#include <mpx/io.h>
+#include <mpx/interrupts.h>
+#include <mpx/pcb.h>
+#include <mpx/sys_call.h>
+
+
+#define PIT_CH0     (0x40)
+#define PIT_CMD     (0x43)
+// channel 0, lobyte/hibyte access, mode 3 (square wave), binary
+#define PIT_CMD_CH0_SQUARE (0x36)
+
+#define TIMER_IRQ (0)
+
+volatile uint32_t timer_ticks = 0;
+volatile unsigned int preempt_depth = 0;
+
+static unsigned int timer_quantum = TIMER_QUANTUM_DEFAULT;
+// process the current slice is being counted for, and the ticks it has used
+static struct pcb* slice_owner = NULL;
+static unsigned int slice_ticks = 0;
+
+/*
+  Hierarchical timer wheel. The first level has a slot per tick for the next
+  TIMER_WHEEL_L0_SZ ticks. Each following level has slots spanning a full
+  rotation of the level below it, and its slots are cascaded down into lower
+  levels as the wheel reaches them. Arming, cancelling and expiring a sleeper
+  are all constant time.
+*/
+#define TIMER_WHEEL_L0_BITS (8)
+#define TIMER_WHEEL_LN_BITS (6)
+#define TIMER_WHEEL_L0_SZ   (1 << TIMER_WHEEL_L0_BITS)
+#define TIMER_WHEEL_LN_SZ   (1 << TIMER_WHEEL_LN_BITS)
+#define TIMER_WHEEL_L0_MASK (TIMER_WHEEL_L0_SZ - 1)
+#define TIMER_WHEEL_LN_MASK (TIMER_WHEEL_LN_SZ - 1)
+// levels above the first, enough to cover the full 32 bit tick range
+#define TIMER_WHEEL_LN_COUNT (4)
+
+static struct pcb* timer_wheel_l0[TIMER_WHEEL_L0_SZ] = { NULL };
+static struct pcb* timer_wheel_ln[TIMER_WHEEL_LN_COUNT][TIMER_WHEEL_LN_SZ] = { { NULL } };
+// next tick the wheel will process, trails timer_ticks while expiry is deferred
+static uint32_t timer_wheel_now = 0;
+
+// slot of level n (above the first) holding a deadline
+#define TIMER_WHEEL_LN_INDEX(deadline, n) \
+    (((deadline) >> (TIMER_WHEEL_L0_BITS + (n) * TIMER_WHEEL_LN_BITS)) & TIMER_WHEEL_LN_MASK)
+
+static void timer_wheel_link(struct pcb* pcb)
+{
+    uint32_t deadline = pcb->timer_deadline;
+    uint32_t delta = deadline - timer_wheel_now;
+    struct pcb** slot;
+
+    if ((int32_t)delta < 0)
+    {
+        // already due, expire on the next tick processed
+        slot = &timer_wheel_l0[timer_wheel_now & TIMER_WHEEL_L0_MASK];
+    }
+    else if (delta < TIMER_WHEEL_L0_SZ)
+    {
+        slot = &timer_wheel_l0[deadline & TIMER_WHEEL_L0_MASK];
+    }
+    else
+    {
+        unsigned int n = 0;
+        while ((n < TIMER_WHEEL_LN_COUNT - 1) &&
+               (delta >= (1u << (TIMER_WHEEL_L0_BITS + (n + 1) * TIMER_WHEEL_LN_BITS))))
+        {
+            ++n;
+        }
+        slot = &timer_wheel_ln[n][TIMER_WHEEL_LN_INDEX(deadline, n)];
+    }
+
+    pcb->p_timer_prev = NULL;
+    pcb->p_timer_next = *slot;
+    if (*slot != NULL)
+    {
+        (*slot)->p_timer_prev = pcb;
+    }
+    *slot = pcb;
+    pcb->p_timer_slot = slot;
+}
+
+static void timer_wheel_unlink(struct pcb* pcb)
+{
+    if (pcb->p_timer_prev != NULL)
+    {
+        pcb->p_timer_prev->p_timer_next = pcb->p_timer_next;
+    }
+    else // at slot head
+    {
+        *pcb->p_timer_slot = pcb->p_timer_next;
+    }
+    if (pcb->p_timer_next != NULL)
+    {
+        pcb->p_timer_next->p_timer_prev = pcb->p_timer_prev;
+    }
+    pcb->p_timer_next = NULL;
+    pcb->p_timer_prev = NULL;
+    pcb->p_timer_slot = NULL;
+}
+
+// moves a sleeper taken off the wheel to its ready queue, sys_req(SLEEP) returns 0
+static void timer_wake_ready(struct pcb* pcb)
+{
+    pcb_remove(pcb);
+    pcb_set_exec(pcb, PCB_EXEC_READY);
+    pcb->pctxt->eax = 0;
+    pcb_insert(pcb);
+}
+
+// re-links every sleeper in a slot of level n, which moves them into lower levels
+static unsigned int timer_wheel_cascade(unsigned int n)
+{
+    unsigned int index = TIMER_WHEEL_LN_INDEX(timer_wheel_now, n);
+    struct pcb* pcb_iter = timer_wheel_ln[n][index];
+    timer_wheel_ln[n][index] = NULL;
+    while (pcb_iter != NULL)
+    {
+        struct pcb* pcb_next = pcb_iter->p_timer_next;
+        timer_wheel_link(pcb_iter);
+        pcb_iter = pcb_next;
+    }
+    return index;
+}
+
+// processes every tick up to and including the given one, waking due sleepers
+static void timer_wheel_advance(uint32_t now)
+{
+    while ((int32_t)(now - timer_wheel_now) >= 0)
+    {
+        unsigned int index = timer_wheel_now & TIMER_WHEEL_L0_MASK;
+        // refill the first level from the levels above once per rotation
+        if (index == 0)
+        {
+            for (unsigned int n = 0; (n < TIMER_WHEEL_LN_COUNT) && (timer_wheel_cascade(n) == 0); ++n)
+            {
+                continue;
+            }
+        }
+        struct pcb* pcb_iter = timer_wheel_l0[index];
+        ++timer_wheel_now;
+        while (pcb_iter != NULL)
+        {
+            struct pcb* pcb_next = pcb_iter->p_timer_next;
+            timer_wheel_unlink(pcb_iter);
+            timer_wake_ready(pcb_iter);
+            pcb_iter = pcb_next;
+        }
+    }
+}
+
+void timer_sleep_until(struct pcb* pcb, uint32_t deadline)
+{
+    preempt_disable();
+    pcb->timer_deadline = deadline;
+    timer_wheel_link(pcb);
+    preempt_enable();
+}
+
+void timer_cancel(struct pcb* pcb)
+{
+    preempt_disable();
+    if (pcb->p_timer_slot != NULL)
+    {
+        timer_wheel_unlink(pcb);
+    }
+    preempt_enable();
+}
+
+void timer_wake(struct pcb* pcb)
+{
+    preempt_disable();
+    if (pcb->p_timer_slot != NULL)
+    {
+        timer_wheel_unlink(pcb);
+        timer_wake_ready(pcb);
+    }
+    preempt_enable();
+}
+
+void timer_init(void)
+{
+    unsigned int divisor = TIMER_PIT_BASE_HZ / TIMER_TICK_HZ;
+
+    cli();
+    idt_install(IRQV_BASE + TIMER_IRQ, timer_isr);
+    outb(PIT_CMD, PIT_CMD_CH0_SQUARE);
+    outb(PIT_CH0, (unsigned char)(divisor));
+    outb(PIT_CH0, (unsigned char)(divisor >> 8));
+    int mask = inb(PIC_1_MASK);
+    mask &= ~IRQ_BIT(TIMER_IRQ);
+    outb(PIC_1_MASK, mask);
+    sti();
+}
+
+unsigned int timer_get_quantum(void)
+{
+    return timer_quantum;
+}
+
+int timer_set_quantum(unsigned int ticks)
+{
+    if ((ticks < TIMER_QUANTUM_MIN) || (ticks > TIMER_QUANTUM_MAX))
+    {
+        return -1;
+    }
+    timer_quantum = ticks;
+    return 0;
+}
+
+struct context* timer_interrupt(struct context* context_in)
+{
+    outb(PIC_1_CMD, PIC_EOI);
+    ++timer_ticks;
+
+    // nothing may be touched while the running process holds kernel structures,
+    // sleepers that come due meanwhile are woken on the next tick that may
+    if (preempt_depth != 0)
+    {
+        return (void*)0;
+    }
+    timer_wheel_advance(timer_ticks);
+    // nothing to preempt while the kernel waits for I/O or timers with no running process
+    if (pcb_running == NULL)
+    {
+        return (void*)0;
+    }
+    // start a new slice whenever a different process has been dispatched
+    if (slice_owner != pcb_running)
+    {
+        slice_owner = pcb_running;
+        slice_ticks = 0;
+    }
+    ++slice_ticks;
+
+    // wake processes with completed I/O so they need not wait on a voluntary syscall
+    sys_check_io();
+
+    struct pcb* front = pcb_queue_front(&pcb_queues[0]);
+    if (front == NULL)
+    {
+        return (void*)0;
+    }
+    // rotate only in favor of higher priorities, or equal priorities once the slice is used up
+    if (
+        (front->state.pri > pcb_running->state.pri) ||
+        ((front->state.pri == pcb_running->state.pri) && (slice_ticks < timer_quantum))
+    )
+    {
+        return (void*)0;
+    }
+    struct pcb* runnext = pcb_next_ready();
+    // requeue the preempted process at the tail of its priority level
+    pcb_running->pctxt = context_in;
+    pcb_set_exec(pcb_running, PCB_EXEC_READY);
+    pcb_insert(pcb_running);
+    // set the running pcb to the dequeued one and return its context to switch to
+    pcb_running = runnext;
+    pcb_set_exec(runnext, PCB_EXEC_RUNNING);
+    return runnext->pctxt;
+}
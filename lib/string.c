@@ -114,3 +114,39 @@ void itoa(char string[], int integer){
 	}
 	string[size] = '\0';
 }
+void u64toa(char string[], uint64_t integer){
+	// powers of ten are subtracted out so no 64-bit division helper is needed
+	static const uint64_t powers[] = {
+		10000000000000000000ULL, 1000000000000000000ULL, 100000000000000000ULL,
+		10000000000000000ULL, 1000000000000000ULL, 100000000000000ULL,
+		10000000000000ULL, 1000000000000ULL, 100000000000ULL, 10000000000ULL,
+		1000000000ULL, 100000000ULL, 10000000ULL, 1000000ULL, 100000ULL,
+		10000ULL, 1000ULL, 100ULL, 10ULL, 1ULL,
+	};
+	size_t i = 0;
+	int size = 0;
+	while (i < sizeof(powers) / sizeof(powers[0]) - 1 && powers[i] > integer) {
+		++i;
+	}
+	for (; i < sizeof(powers) / sizeof(powers[0]); ++i) {
+		char digit = '0';
+		while (integer >= powers[i]) {
+			integer -= powers[i];
+			++digit;
+		}
+		string[size++] = digit;
+	}
+	string[size] = '\0';
+}
+
+size_t strappend(char *buf, size_t len, size_t sz, const char *str){
+	size_t str_len = strlen(str);
+	if (len >= sz) {
+		return len;
+	}
+	if (str_len > sz - len) {
+		str_len = sz - len;
+	}
+	memcpy(buf + len, str, str_len);
+	return len + str_len;
+}
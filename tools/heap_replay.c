@@ -0,0 +1,271 @@
+/*
+  ----- heap_replay.c -----
+
+  Description..: Host side benchmark for the MPX heap. Builds kernel/memory.c
+      natively against a shim for the kernel's virtual memory, then replays a
+      heap trace dumped by the Heap Trace command, or a synthetic workload, and
+      reports throughput, worst case latency and fragmentation.
+
+      Usage: heap-replay [trace file]
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include <mpx/memory.h>
+#include <mpx/vm.h>
+
+// operations of the synthetic workload, and the most blocks it keeps live
+#define REPLAY_SYNTH_OPS  (200000)
+#define REPLAY_SYNTH_LIVE (512)
+
+// traced pointers to replayed pointers, open addressing, must be a power of two
+#define REPLAY_MAP_SZ (1 << 16)
+
+/*
+  Shims for what kernel/memory.c needs from the rest of the kernel. The heap's
+  initial range is mapped at the same address as in the kernel, and pages are
+  backed on first touch by the host as they are by the kernel's fault handler.
+  Pages the heap grows by are mapped right away, as in the kernel.
+*/
+volatile unsigned int preempt_depth = 0;
+
+int vm_region_add(void *base, size_t size)
+{
+    void *addr = mmap(base, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    return (addr == base) ? 0 : -1;
+}
+
+int vm_map(void *vaddr, size_t pages)
+{
+    void *addr = mmap(vaddr, pages * VM_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    return (addr == vaddr) ? 0 : -1;
+}
+
+void vm_unmap(void *vaddr, size_t pages)
+{
+    munmap(vaddr, pages * VM_PAGE_SIZE);
+}
+
+struct replay_stats {
+    unsigned long ops;
+    unsigned long fails;
+    uint64_t total_ns;
+    uint64_t worst_ns;
+    char worst_op;
+    unsigned int peak_frag; // in tenths of a percent
+};
+
+static struct {
+    uintptr_t traced;
+    void *ptr;
+} replay_map[REPLAY_MAP_SZ];
+
+static size_t replay_map_slot(uintptr_t traced)
+{
+    size_t slot = (traced >> 2) * 2654435761u & (REPLAY_MAP_SZ - 1);
+    while (replay_map[slot].traced != 0 && replay_map[slot].traced != traced)
+    {
+        slot = (slot + 1) & (REPLAY_MAP_SZ - 1);
+    }
+    return slot;
+}
+
+static void replay_map_remove(size_t slot)
+{
+    // backward shift deletion keeps every probe sequence unbroken
+    size_t next = (slot + 1) & (REPLAY_MAP_SZ - 1);
+    while (replay_map[next].traced != 0)
+    {
+        size_t home = (replay_map[next].traced >> 2) * 2654435761u & (REPLAY_MAP_SZ - 1);
+        if (((next - home) & (REPLAY_MAP_SZ - 1)) >= ((next - slot) & (REPLAY_MAP_SZ - 1)))
+        {
+            replay_map[slot] = replay_map[next];
+            slot = next;
+        }
+        next = (next + 1) & (REPLAY_MAP_SZ - 1);
+    }
+    replay_map[slot].traced = 0;
+    replay_map[slot].ptr = NULL;
+}
+
+static uint64_t replay_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+// free space outside the largest free block, as a share of all free space
+static unsigned int replay_fragmentation(size_t *largest_out, size_t *free_out)
+{
+    size_t largest = 0, total = 0;
+    for (struct mcb *mcb = heap_block_first(); mcb != NULL; mcb = heap_block_next(mcb))
+    {
+        if (mcb->blk_free)
+        {
+            total += mcb->blk_size;
+            if (mcb->blk_size > largest)
+            {
+                largest = mcb->blk_size;
+            }
+        }
+    }
+    if (largest_out != NULL)
+    {
+        *largest_out = largest;
+    }
+    if (free_out != NULL)
+    {
+        *free_out = total;
+    }
+    return (total == 0) ? 0 : (unsigned int) ((total - largest) * 1000 / total);
+}
+
+static void replay_account(struct replay_stats *stats, char op, uint64_t ns)
+{
+    ++stats->ops;
+    stats->total_ns += ns;
+    if (ns > stats->worst_ns)
+    {
+        stats->worst_ns = ns;
+        stats->worst_op = op;
+    }
+    unsigned int frag = replay_fragmentation(NULL, NULL);
+    if (frag > stats->peak_frag)
+    {
+        stats->peak_frag = frag;
+    }
+}
+
+// replays one operation, matching traced pointers to the pointers they map to now
+static void replay_op(struct replay_stats *stats, char op, size_t size, uintptr_t traced)
+{
+    if (op == 'A')
+    {
+        uint64_t start = replay_now_ns();
+        void *ptr = allocate_memory(size);
+        replay_account(stats, op, replay_now_ns() - start);
+        if (ptr == NULL)
+        {
+            ++stats->fails;
+            return;
+        }
+        if (traced != 0)
+        {
+            size_t slot = replay_map_slot(traced);
+            replay_map[slot].traced = traced;
+            replay_map[slot].ptr = ptr;
+        }
+    }
+    else if (op == 'F' && traced != 0)
+    {
+        size_t slot = replay_map_slot(traced);
+        // the allocation was made before the trace began, or failed when traced
+        if (replay_map[slot].traced == 0)
+        {
+            return;
+        }
+        void *ptr = replay_map[slot].ptr;
+        replay_map_remove(slot);
+        uint64_t start = replay_now_ns();
+        int ret = free_memory(ptr);
+        replay_account(stats, op, replay_now_ns() - start);
+        if (ret != 0)
+        {
+            ++stats->fails;
+        }
+    }
+}
+
+static int replay_trace(struct replay_stats *stats, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char op;
+        unsigned long size, traced;
+        // lines other than operations, such as the begin and end lines, are skipped
+        if (sscanf(line, " %c %lu %lx", &op, &size, &traced) == 3 && (op == 'A' || op == 'F'))
+        {
+            replay_op(stats, op, size, traced);
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+// mostly small blocks with an occasional large one, freed in random order
+static void replay_synthetic(struct replay_stats *stats)
+{
+    uint32_t rng = 2463534242u;
+    uintptr_t live[REPLAY_SYNTH_LIVE] = { 0 };
+    uintptr_t next_id = 1;
+    for (unsigned long i = 0; i < REPLAY_SYNTH_OPS; ++i)
+    {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        size_t idx = rng % REPLAY_SYNTH_LIVE;
+        if (live[idx] != 0)
+        {
+            replay_op(stats, 'F', 0, live[idx]);
+            live[idx] = 0;
+        }
+        else
+        {
+            size_t size = ((rng >> 8) % 16 == 0) ? 1024 + (rng >> 12) % 15360 : 16 + (rng >> 12) % 240;
+            // synthetic ids stand in for traced pointers
+            live[idx] = next_id++ << 2;
+            replay_op(stats, 'A', size, live[idx]);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    initialize_heap(50000);
+    if (heap_block_first() == NULL)
+    {
+        fprintf(stderr, "could not reserve the heap range at %#x\n", VM_HEAP_BASE);
+        return 1;
+    }
+
+    struct replay_stats stats = { 0 };
+    if (argc > 1)
+    {
+        if (replay_trace(&stats, argv[1]) != 0)
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        replay_synthetic(&stats);
+    }
+
+    size_t largest, free_total;
+    replay_fragmentation(&largest, &free_total);
+    double secs = stats.total_ns / 1e9;
+    printf("replay source=%s ops=%lu fails=%lu\n", (argc > 1) ? argv[1] : "synthetic", stats.ops, stats.fails);
+    printf("replay ops_per_sec=%.0f worst_ns=%llu worst_op=%c\n",
+           (secs > 0) ? stats.ops / secs : 0.0, (unsigned long long) stats.worst_ns,
+           stats.worst_op ? stats.worst_op : '-');
+    printf("replay peak_frag=%u.%u%% largest_free=%zu free=%zu\n",
+           stats.peak_frag / 10, stats.peak_frag % 10, largest, free_total);
+    return 0;
+}